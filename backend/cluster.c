@@ -0,0 +1,669 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include "cluster.h"
+#include "task_id.h"
+
+// Wire protocol: one newline-terminated request and one response line per connection.
+//   PUSH <task json>     -> OK | ERR        queue a task routed to this node (deduplicated by ID)
+//   STEAL                -> TASK <json> | NONE, then ACK from the thief before the task is released
+//   DONE <task_id>       -> OK              a task this node scheduled finished elsewhere
+//   STATS                -> STATS <queued> <waiting>
+//   COMPLETED <since>    -> <json array>
+//   SUBMIT <kind> <json> -> <http status> <json>   run a /submit ("task") or /submit_dag ("dag")
+//                                                  whose dependencies this node tracks
+//
+// The protocol is unauthenticated: anyone who can reach the port can queue or take tasks.
+// It is bound to this node's configured host only and must stay on a private network.
+
+// Buffered line reader over a socket
+typedef struct {
+    int fd;
+    char buf[CLUSTER_READ_CHUNK];
+    size_t start;
+    size_t end;
+} LineReader;
+
+typedef struct {
+    Cluster* cluster;
+    LineReader reader;
+} ClusterConnection;
+
+// splitmix64 finalizer, spreads IDs and ring points over the 64-bit ring
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+static int compare_points(const void* a, const void* b) {
+    uint64_t x = ((const ClusterRingPoint*)a)->hash;
+    uint64_t y = ((const ClusterRingPoint*)b)->hash;
+    return x < y ? -1 : x > y;
+}
+
+// Parse "host:port,host:port,..." into the peer table; returns the node count or -1
+static int parse_peers(Cluster* cluster, const char* spec) {
+    char* copy = strdup(spec);
+    if (!copy) return -1;
+
+    int count = 0;
+    char* save = NULL;
+    for (char* item = strtok_r(copy, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        char* colon = strrchr(item, ':');
+        if (!colon || count == CLUSTER_MAX_NODES || (size_t)(colon - item) >= sizeof(cluster->peers[0].host)) {
+            free(copy);
+            return -1;
+        }
+        *colon = '\0';
+        snprintf(cluster->peers[count].host, sizeof(cluster->peers[count].host), "%s", item);
+        cluster->peers[count].port = atoi(colon + 1);
+        if (cluster->peers[count].port <= 0) {
+            free(copy);
+            return -1;
+        }
+        count++;
+    }
+
+    free(copy);
+    return count;
+}
+
+// Place CLUSTER_VNODES points per node on the ring
+static void build_ring(Cluster* cluster) {
+    cluster->ring_size = 0;
+    for (int node = 0; node < cluster->num_nodes; node++) {
+        for (int v = 0; v < CLUSTER_VNODES; v++) {
+            char label[96];
+            snprintf(label, sizeof(label), "%s:%d#%d", cluster->peers[node].host,
+                     cluster->peers[node].port, v);
+            ClusterRingPoint* point = &cluster->ring[cluster->ring_size++];
+            point->hash = mix64(task_id_key(label));
+            point->node = node;
+        }
+    }
+    qsort(cluster->ring, cluster->ring_size, sizeof(ClusterRingPoint), compare_points);
+}
+
+// Apply CLUSTER_TIMEOUT_MS to blocking socket calls
+static void set_timeouts(int fd) {
+    struct timeval tv = {
+        .tv_sec = CLUSTER_TIMEOUT_MS / 1000,
+        .tv_usec = (CLUSTER_TIMEOUT_MS % 1000) * 1000,
+    };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+static int write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static void reader_init(LineReader* reader, int fd) {
+    reader->fd = fd;
+    reader->start = reader->end = 0;
+}
+
+// Read one line (without the newline) into a malloc'd buffer
+static char* read_line(LineReader* reader) {
+    size_t capacity = 256, len = 0;
+    char* line = (char*)malloc(capacity);
+    if (!line) return NULL;
+
+    for (;;) {
+        if (reader->start == reader->end) {
+            ssize_t n = recv(reader->fd, reader->buf, sizeof(reader->buf), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            reader->start = 0;
+            reader->end = (size_t)n;
+        }
+
+        char* chunk = reader->buf + reader->start;
+        size_t available = reader->end - reader->start;
+        char* newline = (char*)memchr(chunk, '\n', available);
+        size_t take = newline ? (size_t)(newline - chunk) : available;
+
+        if (len + take + 1 > capacity) {
+            while (len + take + 1 > capacity) capacity *= 2;
+            if (capacity > CLUSTER_MAX_LINE) break;
+            char* grown = (char*)realloc(line, capacity);
+            if (!grown) break;
+            line = grown;
+        }
+        memcpy(line + len, chunk, take);
+        len += take;
+        reader->start += take;
+
+        if (newline) {
+            reader->start++;
+            line[len] = '\0';
+            return line;
+        }
+    }
+
+    free(line);
+    return NULL;
+}
+
+// Open a connection to a peer; returns -1 if it cannot be reached
+static int peer_connect(Cluster* cluster, int node) {
+    if (node < 0 || node >= cluster->num_nodes) return -1;
+
+    char port[16];
+    snprintf(port, sizeof(port), "%d", cluster->peers[node].port);
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct addrinfo* addrs;
+    if (getaddrinfo(cluster->peers[node].host, port, &hints, &addrs) != 0) return -1;
+
+    int fd = -1;
+    for (struct addrinfo* ai = addrs; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+        set_timeouts(fd);
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addrs);
+    return fd;
+}
+
+// Send a request line on an open connection and return the response line (caller frees).
+// `sent` is set once the request was written, i.e. the peer may have acted on it.
+static char* send_request(LineReader* reader, const char* request, bool* sent) {
+    *sent = false;
+    if (write_all(reader->fd, request, strlen(request)) != 0 ||
+        write_all(reader->fd, "\n", 1) != 0) {
+        return NULL;
+    }
+    *sent = true;
+    return read_line(reader);
+}
+
+// Send a request line to a peer and return its response line (caller frees)
+static char* peer_request(Cluster* cluster, int node, const char* request, bool* sent) {
+    *sent = false;
+    int fd = peer_connect(cluster, node);
+    if (fd < 0) return NULL;
+
+    LineReader reader;
+    reader_init(&reader, fd);
+    char* response = send_request(&reader, request, sent);
+    close(fd);
+    return response;
+}
+
+// Remember a pushed task key; returns true if it was already seen recently
+static bool seen_push(Cluster* cluster, uint64_t key) {
+    return atomic_exchange(&cluster->recent_pushes[key % CLUSTER_RECENT_PUSHES], key) == key;
+}
+
+// Forget a pushed task key again, so a retry after a failed enqueue is accepted
+static void forget_push(Cluster* cluster, uint64_t key) {
+    uint64_t expected = key;
+    atomic_compare_exchange_strong(&cluster->recent_pushes[key % CLUSTER_RECENT_PUSHES], &expected, 0);
+}
+
+// Queue a DONE for redelivery by the listener thread
+static void defer_done(Cluster* cluster, int node, const char* task_id) {
+    ClusterPendingDone* pending = (ClusterPendingDone*)malloc(sizeof(ClusterPendingDone));
+
+    pthread_mutex_lock(&cluster->pending_lock);
+    if (!pending || cluster->pending_count >= CLUSTER_MAX_PENDING_DONE) {
+        pthread_mutex_unlock(&cluster->pending_lock);
+        free(pending);
+        fprintf(stderr, "[CLUSTER] Dropping completion of %s for node %d\n", task_id, node);
+        return;
+    }
+    pending->node = node;
+    snprintf(pending->task_id, sizeof(pending->task_id), "%s", task_id);
+    pending->next = cluster->pending_done;
+    cluster->pending_done = pending;
+    cluster->pending_count++;
+    pthread_mutex_unlock(&cluster->pending_lock);
+}
+
+// Send a DONE; returns 0 once the origin node acknowledged it
+static int send_done(Cluster* cluster, int node, const char* task_id) {
+    char line[128];
+    snprintf(line, sizeof(line), "DONE %s", task_id);
+
+    bool sent;
+    char* response = peer_request(cluster, node, line, &sent);
+    int result = response && strcmp(response, "OK") == 0 ? 0 : -1;
+    free(response);
+    return result;
+}
+
+// Retry every undelivered DONE once; failures stay queued. A node that fails is
+// skipped for the rest of the pass so one dead peer costs a single timeout.
+static void flush_pending_done(Cluster* cluster) {
+    pthread_mutex_lock(&cluster->pending_lock);
+    ClusterPendingDone* pending = cluster->pending_done;
+    cluster->pending_done = NULL;
+    cluster->pending_count = 0;
+    pthread_mutex_unlock(&cluster->pending_lock);
+
+    bool unreachable[CLUSTER_MAX_NODES] = { false };
+    while (pending) {
+        ClusterPendingDone* next = pending->next;
+        if (!unreachable[pending->node] && send_done(cluster, pending->node, pending->task_id) == 0) {
+            free(pending);
+        } else {
+            unreachable[pending->node] = true;
+            pthread_mutex_lock(&cluster->pending_lock);
+            pending->next = cluster->pending_done;
+            cluster->pending_done = pending;
+            cluster->pending_count++;
+            pthread_mutex_unlock(&cluster->pending_lock);
+        }
+        pending = next;
+    }
+}
+
+// Serialize a task and tag it with the node whose scheduler tracks it
+static char* task_line(Cluster* cluster, const char* verb, struct json_object* task) {
+    struct json_object* origin;
+    if (!json_object_object_get_ex(task, "origin_node", &origin)) {
+        json_object_object_add(task, "origin_node", json_object_new_int(cluster->self));
+    }
+
+    const char* json = json_object_to_json_string_ext(task, JSON_C_TO_STRING_PLAIN);
+    size_t len = strlen(verb) + strlen(json) + 2;
+    char* line = (char*)malloc(len);
+    if (line) snprintf(line, len, "%s %s", verb, json);
+    return line;
+}
+
+// Queue a pushed task unless a retry of the same PUSH already queued it
+static int accept_push(Cluster* cluster, const char* json) {
+    struct json_object* task = json_tokener_parse(json);
+    struct json_object* id_obj;
+    if (!task || !json_object_object_get_ex(task, "id", &id_obj)) {
+        json_object_put(task);
+        return -1;
+    }
+
+    uint64_t key = task_id_key(json_object_get_string(id_obj));
+    if (seen_push(cluster, key)) {
+        json_object_put(task);
+        return 0;
+    }
+    if (cluster->handlers.enqueue(task) != 0) {
+        forget_push(cluster, key);
+        json_object_put(task);
+        return -1;
+    }
+    return 0;
+}
+
+// Hand a queued task to a thief; it is released only after the thief's ACK and
+// requeued here otherwise
+static void give_task(Cluster* cluster, LineReader* reader) {
+    struct json_object* task = cluster->handlers.steal();
+    if (!task) {
+        write_all(reader->fd, "NONE\n", 5);
+        return;
+    }
+
+    char* response = task_line(cluster, "TASK", task);
+    char* ack = NULL;
+    bool sent;
+    if (response) ack = send_request(reader, response, &sent);
+
+    if (ack && strcmp(ack, "ACK") == 0) {
+        json_object_put(task);
+    } else if (cluster->handlers.requeue(task) != 0) {
+        fprintf(stderr, "[CLUSTER] Failed to requeue a task after an unacknowledged steal\n");
+        json_object_put(task);
+    }
+    free(ack);
+    free(response);
+}
+
+// Answer one peer request
+static void handle_line(Cluster* cluster, LineReader* reader, const char* line) {
+    char reply[64];
+    int fd = reader->fd;
+
+    if (strncmp(line, "PUSH ", 5) == 0) {
+        int ok = accept_push(cluster, line + 5) == 0;
+        write_all(fd, ok ? "OK\n" : "ERR\n", ok ? 3 : 4);
+    } else if (strcmp(line, "STEAL") == 0) {
+        give_task(cluster, reader);
+    } else if (strncmp(line, "DONE ", 5) == 0) {
+        cluster->handlers.task_done(line + 5);
+        write_all(fd, "OK\n", 3);
+    } else if (strcmp(line, "STATS") == 0) {
+        int queued = 0, waiting = 0;
+        cluster->handlers.stats(&queued, &waiting);
+        int len = snprintf(reply, sizeof(reply), "STATS %d %d\n", queued, waiting);
+        write_all(fd, reply, (size_t)len);
+    } else if (strncmp(line, "SUBMIT ", 7) == 0 && strchr(line + 7, ' ')) {
+        const char* body = strchr(line + 7, ' ') + 1;
+        char kind[16];
+        snprintf(kind, sizeof(kind), "%.*s", (int)(body - 1 - (line + 7)), line + 7);
+
+        int status = 0;
+        char* response = cluster->handlers.submit(kind, body, &status);
+        if (!response) {
+            write_all(fd, "ERR\n", 4);
+            return;
+        }
+        int len = snprintf(reply, sizeof(reply), "%d ", status);
+        write_all(fd, reply, (size_t)len);
+        write_all(fd, response, strlen(response));
+        write_all(fd, "\n", 1);
+        free(response);
+    } else if (strncmp(line, "COMPLETED ", 10) == 0) {
+        struct json_object* tasks = cluster->handlers.completed((time_t)atol(line + 10));
+        const char* json = json_object_to_json_string_ext(tasks, JSON_C_TO_STRING_PLAIN);
+        write_all(fd, json, strlen(json));
+        write_all(fd, "\n", 1);
+        json_object_put(tasks);
+    } else {
+        write_all(fd, "ERR\n", 4);
+    }
+}
+
+// Per-connection thread
+static void* connection_thread(void* arg) {
+    ClusterConnection* conn = (ClusterConnection*)arg;
+
+    char* line = read_line(&conn->reader);
+    if (line) {
+        handle_line(conn->cluster, &conn->reader, line);
+        free(line);
+    }
+
+    close(conn->reader.fd);
+    atomic_fetch_sub(&conn->cluster->active_connections, 1);
+    free(conn);
+    return NULL;
+}
+
+// Accept peer connections until the cluster is destroyed
+static void* listener_thread(void* arg) {
+    Cluster* cluster = (Cluster*)arg;
+    struct pollfd pfd = { .fd = cluster->listen_fd, .events = POLLIN };
+    time_t last_retry = time(NULL);
+
+    while (atomic_load(&cluster->running)) {
+        // Redeliver completions the origin node has not acknowledged yet
+        if ((time(NULL) - last_retry) * 1000 >= CLUSTER_RETRY_MS) {
+            flush_pending_done(cluster);
+            last_retry = time(NULL);
+        }
+
+        if (poll(&pfd, 1, 200) <= 0) continue;
+
+        int fd = accept(cluster->listen_fd, NULL, NULL);
+        if (fd < 0) continue;
+        set_timeouts(fd);
+
+        ClusterConnection* conn = (ClusterConnection*)malloc(sizeof(ClusterConnection));
+        pthread_t thread;
+        if (!conn) {
+            close(fd);
+            continue;
+        }
+        conn->cluster = cluster;
+        reader_init(&conn->reader, fd);
+        atomic_fetch_add(&cluster->active_connections, 1);
+        if (pthread_create(&thread, NULL, connection_thread, conn) != 0) {
+            atomic_fetch_sub(&cluster->active_connections, 1);
+            close(fd);
+            free(conn);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+    return NULL;
+}
+
+// Parse the peer list, build the hash ring and start serving peers on our own port
+Cluster* cluster_init(const char* peers_spec, int self, const ClusterHandlers* handlers) {
+    Cluster* cluster = (Cluster*)calloc(1, sizeof(Cluster));
+    if (!cluster) return NULL;
+
+    cluster->num_nodes = parse_peers(cluster, peers_spec);
+    if (cluster->num_nodes <= 0 || self < 0 || self >= cluster->num_nodes) {
+        fprintf(stderr, "[CLUSTER] Invalid peer list or node index %d\n", self);
+        free(cluster);
+        return NULL;
+    }
+    cluster->self = self;
+    cluster->handlers = *handlers;
+    atomic_init(&cluster->running, true);
+    atomic_init(&cluster->active_connections, 0);
+    atomic_init(&cluster->next_victim, self + 1);
+    pthread_mutex_init(&cluster->pending_lock, NULL);
+    build_ring(cluster);
+
+    // Listen only on the address the other nodes use for us, never on all interfaces
+    char port[16];
+    snprintf(port, sizeof(port), "%d", cluster->peers[self].port);
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM, .ai_flags = AI_PASSIVE };
+    struct addrinfo* addrs = NULL;
+    int reuse = 1;
+    cluster->listen_fd = -1;
+    if (getaddrinfo(cluster->peers[self].host, port, &hints, &addrs) == 0) {
+        for (struct addrinfo* ai = addrs; ai && cluster->listen_fd < 0; ai = ai->ai_next) {
+            int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (fd < 0) continue;
+            if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) == 0 &&
+                bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 64) == 0) {
+                cluster->listen_fd = fd;
+            } else {
+                close(fd);
+            }
+        }
+        freeaddrinfo(addrs);
+    }
+    if (cluster->listen_fd < 0) {
+        fprintf(stderr, "[CLUSTER] Failed to listen on %s:%d\n", cluster->peers[self].host,
+                cluster->peers[self].port);
+        pthread_mutex_destroy(&cluster->pending_lock);
+        free(cluster);
+        return NULL;
+    }
+
+    if (pthread_create(&cluster->listener, NULL, listener_thread, cluster) != 0) {
+        close(cluster->listen_fd);
+        pthread_mutex_destroy(&cluster->pending_lock);
+        free(cluster);
+        return NULL;
+    }
+
+    printf("[CLUSTER] Node %d of %d listening on %s:%d\n", self, cluster->num_nodes,
+           cluster->peers[self].host, cluster->peers[self].port);
+    return cluster;
+}
+
+// Node responsible for a task ID
+int cluster_owner(Cluster* cluster, const char* task_id) {
+    uint64_t hash = mix64(task_id_key(task_id));
+
+    int lo = 0, hi = cluster->ring_size;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (cluster->ring[mid].hash < hash) lo = mid + 1;
+        else hi = mid;
+    }
+    return cluster->ring[lo % cluster->ring_size].node;
+}
+
+// Send a task to the node that owns it. PUSH is deduplicated by task ID on the
+// receiver, so a PUSH the peer may have received is retried rather than given up.
+// Returns CLUSTER_FORWARD_OK once the peer queued it, CLUSTER_FORWARD_FAILED if it
+// never got it, or CLUSTER_FORWARD_UNCONFIRMED if it may have. The caller keeps its
+// reference to the task either way.
+int cluster_forward(Cluster* cluster, int node, struct json_object* task) {
+    char* line = task_line(cluster, "PUSH", task);
+    if (!line) return CLUSTER_FORWARD_FAILED;
+
+    int result = CLUSTER_FORWARD_FAILED;
+    for (int attempt = 0; attempt < CLUSTER_PUSH_ATTEMPTS; attempt++) {
+        bool sent;
+        char* response = peer_request(cluster, node, line, &sent);
+        bool ok = response && strcmp(response, "OK") == 0;
+        free(response);
+
+        if (ok) {
+            result = CLUSTER_FORWARD_OK;
+            break;
+        }
+        if (sent) {
+            result = CLUSTER_FORWARD_UNCONFIRMED;
+        } else if (result == CLUSTER_FORWARD_FAILED) {
+            break;  // Never delivered and the peer is unreachable
+        }
+    }
+
+    free(line);
+    return result;
+}
+
+// Ask the next peer in turn for a queued task; returns NULL if it has none
+struct json_object* cluster_steal(Cluster* cluster) {
+    if (cluster->num_nodes < 2) return NULL;
+
+    int node = atomic_fetch_add(&cluster->next_victim, 1) % cluster->num_nodes;
+    if (node == cluster->self) node = (node + 1) % cluster->num_nodes;
+
+    int fd = peer_connect(cluster, node);
+    if (fd < 0) return NULL;
+
+    LineReader reader;
+    reader_init(&reader, fd);
+    bool sent;
+    char* response = send_request(&reader, "STEAL", &sent);
+    struct json_object* task = NULL;
+    if (response && strncmp(response, "TASK ", 5) == 0) {
+        task = json_tokener_parse(response + 5);
+    }
+
+    // The victim requeues the task unless it gets our ACK, so only keep it if the ACK went out
+    if (task && write_all(fd, "ACK\n", 4) != 0) {
+        json_object_put(task);
+        task = NULL;
+    }
+    if (task) printf("[CLUSTER] Stole a task from node %d\n", node);
+
+    close(fd);
+    free(response);
+    return task;
+}
+
+// Tell the scheduling node that one of its tasks finished here; undelivered
+// reports are retried until the node acknowledges them
+void cluster_report_done(Cluster* cluster, int node, const char* task_id) {
+    if (send_done(cluster, node, task_id) != 0) {
+        fprintf(stderr, "[CLUSTER] Failed to report completion of %s to node %d, will retry\n",
+                task_id, node);
+        defer_done(cluster, node, task_id);
+    }
+}
+
+// Queue depth of a peer; returns -1 if it is unreachable
+int cluster_peer_stats(Cluster* cluster, int node, int* queued, int* waiting) {
+    bool sent;
+    char* response = peer_request(cluster, node, "STATS", &sent);
+    int result = response && sscanf(response, "STATS %d %d", queued, waiting) == 2 ? 0 : -1;
+    free(response);
+    return result;
+}
+
+// Completed tasks of a peer as a JSON array, or NULL if it is unreachable
+struct json_object* cluster_peer_completed(Cluster* cluster, int node, time_t since) {
+    char line[64];
+    snprintf(line, sizeof(line), "COMPLETED %ld", (long)since);
+
+    bool sent;
+    char* response = peer_request(cluster, node, line, &sent);
+    struct json_object* tasks = response ? json_tokener_parse(response) : NULL;
+    free(response);
+
+    if (tasks && !json_object_is_type(tasks, json_type_array)) {
+        json_object_put(tasks);
+        tasks = NULL;
+    }
+    return tasks;
+}
+
+// Run a submit on the node that tracks its dependencies. Returns that node's response
+// body (caller frees) and HTTP status, or NULL; `sent` tells whether the node may have
+// acted on the request anyway.
+char* cluster_submit(Cluster* cluster, int node, const char* kind, const char* body,
+                     int* status, bool* sent) {
+    size_t len = strlen(kind) + strlen(body) + 9;
+    char* request = (char*)malloc(len);
+    *sent = false;
+    if (!request) return NULL;
+    snprintf(request, len, "SUBMIT %s %s", kind, body);
+
+    char* response = peer_request(cluster, node, request, sent);
+    free(request);
+
+    char* space = response ? strchr(response, ' ') : NULL;
+    if (!space || sscanf(response, "%d", status) != 1) {
+        free(response);
+        return NULL;
+    }
+    memmove(response, space + 1, strlen(space + 1) + 1);
+    return response;
+}
+
+// Stop serving peers and wait for requests in progress; once this returns no peer can
+// queue or take tasks here. Safe to call more than once.
+void cluster_stop(Cluster* cluster) {
+    if (!cluster || !atomic_exchange(&cluster->running, false)) return;
+
+    pthread_join(cluster->listener, NULL);
+    close(cluster->listen_fd);
+
+    // Connection threads are detached; wait for in-flight requests to finish
+    while (atomic_load(&cluster->active_connections) > 0) {
+        usleep(10000);
+    }
+}
+
+// Stop serving peers and clean up
+void cluster_destroy(Cluster* cluster) {
+    if (!cluster) return;
+
+    cluster_stop(cluster);
+
+    // Last delivery attempt for completions still owed to other nodes
+    flush_pending_done(cluster);
+    ClusterPendingDone* pending = cluster->pending_done;
+    if (pending) {
+        fprintf(stderr, "[CLUSTER] %d completions could not be delivered\n", cluster->pending_count);
+    }
+    while (pending) {
+        ClusterPendingDone* next = pending->next;
+        free(pending);
+        pending = next;
+    }
+    pthread_mutex_destroy(&cluster->pending_lock);
+    free(cluster);
+}
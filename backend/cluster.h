@@ -0,0 +1,88 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <json-c/json.h>
+
+#define CLUSTER_MAX_NODES 16
+#define CLUSTER_VNODES 64             // Ring points per node
+#define CLUSTER_MAX_LINE (1 << 20)    // Longest protocol line accepted
+#define CLUSTER_TIMEOUT_MS 500        // Connect/send/receive timeout for peer requests
+#define CLUSTER_READ_CHUNK 4096       // Socket read buffer per connection
+#define CLUSTER_PUSH_ATTEMPTS 3       // PUSH retries while a peer has not confirmed
+#define CLUSTER_RECENT_PUSHES 4096    // Recently received PUSH IDs remembered for dedup
+#define CLUSTER_RETRY_MS 1000         // Interval between redelivery attempts of DONE
+#define CLUSTER_MAX_PENDING_DONE 65536
+
+// cluster_forward results
+#define CLUSTER_FORWARD_OK 0
+#define CLUSTER_FORWARD_FAILED -1       // The peer never received the task
+#define CLUSTER_FORWARD_UNCONFIRMED -2  // The peer may have queued the task
+
+// Local hooks the cluster protocol calls into
+typedef struct {
+    int (*enqueue)(struct json_object* task);           // Queue a task a peer routed here
+    struct json_object* (*steal)(void);                 // Give a queued task to an idle peer
+    int (*requeue)(struct json_object* task);           // Take back a task whose steal failed
+    void (*task_done)(const char* task_id);             // A task we scheduled finished elsewhere
+    void (*stats)(int* queued, int* waiting);           // Local queue depth
+    struct json_object* (*completed)(time_t since);     // Local completed tasks (JSON array)
+    char* (*submit)(const char* kind, const char* body, int* status);  // Forwarded submit
+} ClusterHandlers;
+
+// One ThreadFlow node's cluster endpoint
+typedef struct {
+    char host[64];
+    int port;
+} ClusterPeer;
+
+// A DONE message waiting for the origin node to acknowledge it
+typedef struct ClusterPendingDone {
+    int node;
+    char task_id[64];
+    struct ClusterPendingDone* next;
+} ClusterPendingDone;
+
+// Consistent hash ring point
+typedef struct {
+    uint64_t hash;
+    int node;
+} ClusterRingPoint;
+
+// Cluster structure
+typedef struct Cluster {
+    ClusterPeer peers[CLUSTER_MAX_NODES];
+    int num_nodes;
+    int self;                         // Index of this node in peers
+    ClusterRingPoint ring[CLUSTER_MAX_NODES * CLUSTER_VNODES];
+    int ring_size;
+    ClusterHandlers handlers;
+    int listen_fd;
+    pthread_t listener;
+    atomic_bool running;
+    atomic_int active_connections;
+    atomic_int next_victim;           // Round-robin peer to steal from
+    _Atomic uint64_t recent_pushes[CLUSTER_RECENT_PUSHES];  // Task keys, direct-mapped
+    ClusterPendingDone* pending_done; // Undelivered DONE messages, retried by the listener
+    int pending_count;
+    pthread_mutex_t pending_lock;
+} Cluster;
+
+// Core functions
+Cluster* cluster_init(const char* peers_spec, int self, const ClusterHandlers* handlers);
+int cluster_owner(Cluster* cluster, const char* task_id);
+int cluster_forward(Cluster* cluster, int node, struct json_object* task);
+struct json_object* cluster_steal(Cluster* cluster);
+void cluster_report_done(Cluster* cluster, int node, const char* task_id);
+int cluster_peer_stats(Cluster* cluster, int node, int* queued, int* waiting);
+struct json_object* cluster_peer_completed(Cluster* cluster, int node, time_t since);
+char* cluster_submit(Cluster* cluster, int node, const char* kind, const char* body,
+                     int* status, bool* sent);
+void cluster_stop(Cluster* cluster);
+void cluster_destroy(Cluster* cluster);
+
+#endif // CLUSTER_H
@@ -0,0 +1,596 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "dag.h"
+#include "task_id.h"
+
+// Bucket for a task ID
+static unsigned int hash_id(const char* id) {
+    return (unsigned int)(task_id_key(id) % DAG_BUCKETS);
+}
+
+// Find a node by task ID (lock must be held)
+static DagNode* find_node(DagScheduler* sched, const char* task_id) {
+    DagNode* node = sched->buckets[hash_id(task_id)];
+    while (node && strcmp(node->task_id, task_id) != 0) {
+        node = node->next;
+    }
+    return node;
+}
+
+// Stripe and bucket of the untracked set holding a task ID
+static DagUntracked** untracked_slot(DagScheduler* sched, const char* task_id,
+                                     DagUntrackedStripe** stripe) {
+    uint64_t key = task_id_key(task_id);
+    *stripe = &sched->untracked[key % DAG_UNTRACKED_STRIPES];
+    return &(*stripe)->buckets[(key / DAG_UNTRACKED_STRIPES) % DAG_UNTRACKED_BUCKETS];
+}
+
+// Remember that a task completed (stripe lock must be held)
+static void record_done(DagUntrackedStripe* stripe, uint64_t key) {
+    stripe->done_keys[stripe->done_next] = key;
+    stripe->done_next = (stripe->done_next + 1) % DAG_DONE_KEYS;
+    if (stripe->done_count < DAG_DONE_KEYS) stripe->done_count++;
+}
+
+// Whether a task with this key completed recently (stripe lock must be held)
+static bool is_done(DagUntrackedStripe* stripe, uint64_t key) {
+    for (int i = 0; i < stripe->done_count; i++) {
+        if (stripe->done_keys[i] == key) return true;
+    }
+    return false;
+}
+
+// Remove an untracked task; returns 1 if it was untracked and unwatched (nothing left
+// to do), 0 if the scheduler has a node for it
+static int take_untracked(DagScheduler* sched, const char* task_id) {
+    DagUntrackedStripe* stripe;
+    DagUntracked** link = untracked_slot(sched, task_id, &stripe);
+
+    pthread_mutex_lock(&stripe->lock);
+    while (*link && strcmp((*link)->task_id, task_id) != 0) {
+        link = &(*link)->next;
+    }
+    DagUntracked* entry = *link;
+    if (entry) *link = entry->next;
+    int done = entry && !entry->watched;
+    if (done) record_done(stripe, task_id_key(task_id));
+    pthread_mutex_unlock(&stripe->lock);
+
+    free(entry);
+    return done;
+}
+
+// Record a tracked task's completion next to the untracked ones (scheduler lock must be held)
+static void remember_completed(DagScheduler* sched, const char* task_id) {
+    DagUntrackedStripe* stripe;
+    untracked_slot(sched, task_id, &stripe);
+    pthread_mutex_lock(&stripe->lock);
+    record_done(stripe, task_id_key(task_id));
+    pthread_mutex_unlock(&stripe->lock);
+}
+
+// Open-addressing index from task ID to position in a batch, sized to a power of two
+// of at least twice the batch so probes stay short
+typedef struct {
+    int* slots;                 // Batch position + 1, 0 when empty
+    size_t mask;
+} BatchIndex;
+
+// Allocate an empty index for `count` tasks; returns -1 on allocation failure
+static int batch_index_init(BatchIndex* index, int count) {
+    size_t size = 16;
+    while (size < (size_t)count * 2) size <<= 1;
+    index->slots = (int*)calloc(size, sizeof(int));
+    index->mask = size - 1;
+    return index->slots ? 0 : -1;
+}
+
+// Position of a task ID in the batch, or -1
+static int batch_index_find(const BatchIndex* index, DagTaskSpec* specs, const char* task_id) {
+    for (size_t slot = task_id_key(task_id) & index->mask; index->slots[slot];
+         slot = (slot + 1) & index->mask) {
+        int i = index->slots[slot] - 1;
+        if (strcmp(specs[i].task_id, task_id) == 0) return i;
+    }
+    return -1;
+}
+
+// Add batch position `i`; returns -1 if its task ID is already in the batch
+static int batch_index_add(BatchIndex* index, DagTaskSpec* specs, int i) {
+    size_t slot = task_id_key(specs[i].task_id) & index->mask;
+    for (; index->slots[slot]; slot = (slot + 1) & index->mask) {
+        if (strcmp(specs[index->slots[slot] - 1].task_id, specs[i].task_id) == 0) return -1;
+    }
+    index->slots[slot] = i + 1;
+    return 0;
+}
+
+// Resolve dependencies inside the batch and reject cycles (Kahn's algorithm over an
+// adjacency list), all without the scheduler lock. internal[] gets, per dependency in
+// spec order, the batch position it names or -1 for a task outside the batch.
+static int check_batch(DagTaskSpec* specs, int count, int total_deps, int* internal) {
+    BatchIndex index;
+    int* indegree = (int*)calloc(count, sizeof(int));
+    int* first_out = (int*)calloc(count + 1, sizeof(int));
+    int* fill = (int*)malloc(sizeof(int) * count);
+    int* order = (int*)malloc(sizeof(int) * count);
+    int* out = (int*)malloc(sizeof(int) * (total_deps > 0 ? total_deps : 1));
+    int result = DAG_OK;
+    if (batch_index_init(&index, count) != 0 || !indegree || !first_out || !fill || !order || !out) {
+        result = DAG_ERR_NOMEM;
+    }
+
+    for (int i = 0; i < count && result == DAG_OK; i++) {
+        if (batch_index_add(&index, specs, i) != 0) result = DAG_ERR_DUPLICATE;
+    }
+
+    if (result == DAG_OK) {
+        for (int i = 0, slot = 0; i < count; i++) {
+            for (int d = 0; d < specs[i].dep_count; d++, slot++) {
+                internal[slot] = batch_index_find(&index, specs, specs[i].depends_on[d]);
+                if (internal[slot] >= 0) first_out[internal[slot] + 1]++;
+            }
+        }
+
+        // Edges dependency -> dependent, grouped by dependency
+        for (int i = 0; i < count; i++) first_out[i + 1] += first_out[i];
+        memcpy(fill, first_out, sizeof(int) * count);
+        for (int i = 0, slot = 0; i < count; i++) {
+            for (int d = 0; d < specs[i].dep_count; d++, slot++) {
+                if (internal[slot] < 0) continue;
+                out[fill[internal[slot]]++] = i;
+                indegree[i]++;
+            }
+        }
+
+        int head = 0, tail = 0;
+        for (int i = 0; i < count; i++) {
+            if (indegree[i] == 0) order[tail++] = i;
+        }
+        while (head < tail) {
+            int node = order[head++];
+            for (int e = first_out[node]; e < first_out[node + 1]; e++) {
+                if (--indegree[out[e]] == 0) order[tail++] = out[e];
+            }
+        }
+        if (tail != count) result = DAG_ERR_CYCLE;
+    }
+
+    free(index.slots);
+    free(indegree);
+    free(first_out);
+    free(fill);
+    free(order);
+    free(out);
+    return result;
+}
+
+// Record that `dependent` must wait for `node` (lock must be held)
+static int add_dependent(DagNode* node, DagNode* dependent) {
+    if (node->dependent_count == node->dependent_capacity) {
+        int capacity = node->dependent_capacity ? node->dependent_capacity * 2 : 4;
+        DagNode** grown = (DagNode**)realloc(node->dependents, sizeof(DagNode*) * capacity);
+        if (!grown) return -1;
+        node->dependents = grown;
+        node->dependent_capacity = capacity;
+    }
+    node->dependents[node->dependent_count++] = dependent;
+    return 0;
+}
+
+// Unlink a node from its hash bucket (lock must be held)
+static void remove_node(DagScheduler* sched, DagNode* target) {
+    DagNode** link = &sched->buckets[hash_id(target->task_id)];
+    while (*link && *link != target) {
+        link = &(*link)->next;
+    }
+    if (*link) *link = target->next;
+}
+
+// Keep completed nodes resolvable for a while, dropping the oldest (lock must be held)
+static void retire_node(DagScheduler* sched, DagNode* node) {
+    node->retired_next = NULL;
+    if (sched->retired_tail) {
+        sched->retired_tail->retired_next = node;
+    } else {
+        sched->retired_head = node;
+    }
+    sched->retired_tail = node;
+    sched->retired_count++;
+
+    while (sched->retired_count > DAG_MAX_RETIRED) {
+        DagNode* oldest = sched->retired_head;
+        sched->retired_head = oldest->retired_next;
+        if (!sched->retired_head) sched->retired_tail = NULL;
+        sched->retired_count--;
+        remove_node(sched, oldest);
+        free(oldest);
+    }
+}
+
+// Drop the oldest finished DAG once over the limit (lock must be held)
+static void trim_dags(DagScheduler* sched) {
+    while (sched->dag_count > DAG_MAX_DAGS) {
+        Dag** victim = NULL;
+        for (Dag** link = &sched->dags; *link; link = &(*link)->next) {
+            if (atomic_load(&(*link)->completed) >= (*link)->total) {
+                victim = link;
+            }
+        }
+        if (!victim) return;
+
+        Dag* dag = *victim;
+        *victim = dag->next;
+        free(dag);
+        sched->dag_count--;
+    }
+}
+
+// Make a dependency outside the batch resolvable (lock must be held). A running untracked
+// task gets a node so it can release dependents; a recently completed one needs no edge.
+// Anything else is unknown, or may still come with a predecessor's backlog.
+static int resolve_dependency(DagScheduler* sched, const char* task_id) {
+    if (find_node(sched, task_id)) return DAG_OK;
+
+    DagUntrackedStripe* stripe;
+    DagUntracked* entry = *untracked_slot(sched, task_id, &stripe);
+
+    pthread_mutex_lock(&stripe->lock);
+    while (entry && strcmp(entry->task_id, task_id) != 0) {
+        entry = entry->next;
+    }
+    if (!entry) {
+        bool done = is_done(stripe, task_id_key(task_id));
+        pthread_mutex_unlock(&stripe->lock);
+        if (done) return DAG_OK;
+        return atomic_load(&sched->restoring) ? DAG_ERR_RESTORING : DAG_ERR_UNKNOWN_DEP;
+    }
+
+    DagNode* node = (DagNode*)calloc(1, sizeof(DagNode));
+    if (!node) {
+        pthread_mutex_unlock(&stripe->lock);
+        return DAG_ERR_NOMEM;
+    }
+    entry->watched = true;
+    pthread_mutex_unlock(&stripe->lock);
+
+    // Already dispatched, so the node only collects dependents until completion
+    strncpy(node->task_id, task_id, DAG_ID_LEN - 1);
+    atomic_init(&node->pending, 0);
+    unsigned int bucket = hash_id(node->task_id);
+    node->next = sched->buckets[bucket];
+    sched->buckets[bucket] = node;
+    return DAG_OK;
+}
+
+// Drop one pending count and dispatch the node once nothing is left
+static void release_node(DagScheduler* sched, DagNode* node) {
+    if (atomic_fetch_sub(&node->pending, 1) != 1) return;
+
+    struct json_object* task = node->task;
+    node->task = NULL;
+    atomic_fetch_sub(&sched->waiting, 1);
+
+    if (sched->dispatch(task, node->priority) != 0) {
+        fprintf(stderr, "[DAG] Failed to dispatch task %s\n", node->task_id);
+        json_object_put(task);
+    }
+}
+
+// Initialize a new scheduler
+DagScheduler* dag_scheduler_init(DagDispatchFn dispatch) {
+    DagScheduler* sched = (DagScheduler*)aligned_alloc(64, sizeof(DagScheduler));
+    if (!sched) return NULL;
+
+    memset(sched, 0, sizeof(DagScheduler));
+    for (int i = 0; i < DAG_UNTRACKED_STRIPES; i++) {
+        pthread_mutex_init(&sched->untracked[i].lock, NULL);
+    }
+    sched->dispatch = dispatch;
+    atomic_init(&sched->waiting, 0);
+    atomic_init(&sched->restoring, false);
+    pthread_mutex_init(&sched->lock, NULL);
+    return sched;
+}
+
+// Allocate a DAG; ownership passes to the scheduler once a batch is accepted
+Dag* dag_create(DagScheduler* sched, const char* dag_id, int total) {
+    if (!sched) return NULL;
+
+    Dag* dag = (Dag*)calloc(1, sizeof(Dag));
+    if (!dag) return NULL;
+
+    strncpy(dag->dag_id, dag_id, DAG_ID_LEN - 1);
+    dag->total = total;
+    atomic_init(&dag->completed, 0);
+    return dag;
+}
+
+// Register a batch of tasks; tasks without open dependencies are dispatched right away.
+// Dependencies may name earlier tasks (running, waiting or recently completed) or other
+// tasks of the same batch.
+int dag_submit_batch(DagScheduler* sched, Dag* dag, DagTaskSpec* specs, int count) {
+    if (!sched || !specs || count <= 0) return DAG_ERR_NOMEM;
+
+    int total_deps = 0;
+    for (int i = 0; i < count; i++) total_deps += specs[i].dep_count;
+
+    DagNode** nodes = (DagNode**)calloc(count, sizeof(DagNode*));
+    int* internal = (int*)malloc(sizeof(int) * (total_deps > 0 ? total_deps : 1));
+    int result = nodes && internal ? check_batch(specs, count, total_deps, internal) : DAG_ERR_NOMEM;
+    for (int i = 0; i < count && result == DAG_OK; i++) {
+        nodes[i] = (DagNode*)calloc(1, sizeof(DagNode));
+        if (!nodes[i]) result = DAG_ERR_NOMEM;
+    }
+
+    // Only lookups against tasks outside the batch need the lock
+    if (result == DAG_OK) {
+        pthread_mutex_lock(&sched->lock);
+        for (int i = 0, slot = 0; i < count && result == DAG_OK; i++) {
+            if (find_node(sched, specs[i].task_id)) {
+                result = DAG_ERR_DUPLICATE;
+                break;
+            }
+            for (int d = 0; d < specs[i].dep_count; d++, slot++) {
+                if (internal[slot] >= 0) continue;
+                if ((result = resolve_dependency(sched, specs[i].depends_on[d])) != DAG_OK) break;
+            }
+        }
+        if (result != DAG_OK) pthread_mutex_unlock(&sched->lock);
+    }
+
+    if (result != DAG_OK) {
+        for (int i = 0; nodes && i < count; i++) free(nodes[i]);
+        free(nodes);
+        free(internal);
+        return result;
+    }
+
+    // Register every node, holding one extra pending count while edges are wired
+    for (int i = 0; i < count; i++) {
+        DagNode* node = nodes[i];
+        strncpy(node->task_id, specs[i].task_id, DAG_ID_LEN - 1);
+        node->task = specs[i].task;
+        node->priority = specs[i].priority;
+        node->dag = dag;
+        atomic_init(&node->pending, 1);
+
+        unsigned int bucket = hash_id(node->task_id);
+        node->next = sched->buckets[bucket];
+        sched->buckets[bucket] = node;
+    }
+
+    for (int i = 0, slot = 0; i < count; i++) {
+        for (int d = 0; d < specs[i].dep_count; d++, slot++) {
+            DagNode* dep = internal[slot] >= 0 ? nodes[internal[slot]]
+                                               : find_node(sched, specs[i].depends_on[d]);
+            if (!dep || dep->completed) continue;
+            if (add_dependent(dep, nodes[i]) == 0) {
+                atomic_fetch_add(&nodes[i]->pending, 1);
+            } else {
+                fprintf(stderr, "[DAG] Out of memory wiring %s -> %s\n",
+                        dep->task_id, nodes[i]->task_id);
+            }
+        }
+    }
+
+    if (dag) {
+        dag->next = sched->dags;
+        sched->dags = dag;
+        sched->dag_count++;
+        trim_dags(sched);
+    }
+    atomic_fetch_add(&sched->waiting, count);
+
+    pthread_mutex_unlock(&sched->lock);
+
+    // Drop the wiring guard; anything without open dependencies runs now
+    for (int i = 0; i < count; i++) {
+        release_node(sched, nodes[i]);
+    }
+
+    free(nodes);
+    free(internal);
+    return DAG_OK;
+}
+
+// Dispatch a task without dependencies, skipping the scheduler lock. It is only
+// remembered until it completes, in case a later task depends on it meanwhile.
+// On failure the caller keeps ownership of the task.
+int dag_submit_untracked(DagScheduler* sched, const char* task_id, struct json_object* task,
+                         int priority) {
+    if (!sched || !task_id || strlen(task_id) >= DAG_ID_LEN) return DAG_ERR_NOMEM;
+
+    DagUntracked* entry = (DagUntracked*)calloc(1, sizeof(DagUntracked));
+    if (!entry) return DAG_ERR_NOMEM;
+    strcpy(entry->task_id, task_id);
+
+    // Registered before dispatch, since the task may complete before dispatch returns
+    DagUntrackedStripe* stripe;
+    DagUntracked** bucket = untracked_slot(sched, task_id, &stripe);
+    pthread_mutex_lock(&stripe->lock);
+    entry->next = *bucket;
+    *bucket = entry;
+    pthread_mutex_unlock(&stripe->lock);
+
+    if (sched->dispatch(task, priority) != 0) {
+        // Release anything that started depending on it rather than leave it stuck
+        if (!take_untracked(sched, task_id)) dag_task_completed(sched, task_id);
+        return DAG_ERR_NOMEM;
+    }
+    return DAG_OK;
+}
+
+// Mark a task finished and release its dependents straight into the ready queue
+void dag_task_completed(DagScheduler* sched, const char* task_id) {
+    if (!sched || !task_id) return;
+    if (take_untracked(sched, task_id)) return;
+
+    pthread_mutex_lock(&sched->lock);
+
+    DagNode* node = find_node(sched, task_id);
+    if (!node || node->completed) {
+        pthread_mutex_unlock(&sched->lock);
+        return;
+    }
+
+    node->completed = true;
+    DagNode** dependents = node->dependents;
+    int dependent_count = node->dependent_count;
+    node->dependents = NULL;
+    node->dependent_count = node->dependent_capacity = 0;
+
+    if (node->dag) {
+        int done = atomic_fetch_add(&node->dag->completed, 1) + 1;
+        if (done == node->dag->total) {
+            printf("[DAG] DAG %s completed (%d tasks)\n", node->dag->dag_id, done);
+        }
+        node->dag = NULL;
+    }
+    remember_completed(sched, task_id);
+    retire_node(sched, node);
+
+    pthread_mutex_unlock(&sched->lock);
+
+    // Dependents cannot complete (or be retired) before this release, so the pointers stay valid
+    for (int i = 0; i < dependent_count; i++) {
+        release_node(sched, dependents[i]);
+    }
+    free(dependents);
+}
+
+// Look up completion progress of a DAG
+int dag_get_status(DagScheduler* sched, const char* dag_id, int* total, int* completed) {
+    if (!sched || !dag_id) return -1;
+
+    int found = -1;
+    pthread_mutex_lock(&sched->lock);
+    for (Dag* dag = sched->dags; dag; dag = dag->next) {
+        if (strcmp(dag->dag_id, dag_id) == 0) {
+            *total = dag->total;
+            *completed = atomic_load(&dag->completed);
+            found = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&sched->lock);
+
+    return found;
+}
+
+// Number of tasks still waiting on dependencies
+int dag_waiting_count(DagScheduler* sched) {
+    if (!sched) return 0;
+    return atomic_load_explicit(&sched->waiting, memory_order_relaxed);
+}
+
+// Check whether the scheduler knows a task ID (waiting, running or recently completed)
+bool dag_has_task(DagScheduler* sched, const char* task_id) {
+    if (!sched || !task_id) return false;
+
+    pthread_mutex_lock(&sched->lock);
+    bool found = find_node(sched, task_id) != NULL;
+    pthread_mutex_unlock(&sched->lock);
+    if (found) return true;
+
+    DagUntrackedStripe* stripe;
+    DagUntracked* entry = *untracked_slot(sched, task_id, &stripe);
+    pthread_mutex_lock(&stripe->lock);
+    while (entry && strcmp(entry->task_id, task_id) != 0) {
+        entry = entry->next;
+    }
+    found = entry || is_done(stripe, task_id_key(task_id));
+    pthread_mutex_unlock(&stripe->lock);
+    return found;
+}
+
+// While set, dependencies that are not known yet are refused with DAG_ERR_RESTORING
+// instead of DAG_ERR_UNKNOWN_DEP, since the previous process may still hand them over
+void dag_set_restoring(DagScheduler* sched, bool restoring) {
+    if (sched) atomic_store(&sched->restoring, restoring);
+}
+
+// Hand every task still waiting on dependencies to `emit`, with depends_on rewritten to
+// the dependencies that have not completed yet; returns the number of tasks emitted
+int dag_export_waiting(DagScheduler* sched, DagExportFn emit, void* ctx) {
+    if (!sched || !emit) return 0;
+
+    int count = 0;
+    pthread_mutex_lock(&sched->lock);
+
+    for (int i = 0; i < DAG_BUCKETS; i++) {
+        for (DagNode* node = sched->buckets[i]; node; node = node->next) {
+            if (node->task) {
+                json_object_object_add(node->task, "depends_on", json_object_new_array());
+            }
+        }
+    }
+
+    // Only unfinished nodes still list dependents, so these edges are exactly the open ones
+    for (int i = 0; i < DAG_BUCKETS; i++) {
+        for (DagNode* node = sched->buckets[i]; node; node = node->next) {
+            for (int d = 0; d < node->dependent_count; d++) {
+                struct json_object* depends_on;
+                struct json_object* task = node->dependents[d]->task;
+                if (task && json_object_object_get_ex(task, "depends_on", &depends_on)) {
+                    json_object_array_add(depends_on, json_object_new_string(node->task_id));
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < DAG_BUCKETS; i++) {
+        for (DagNode* node = sched->buckets[i]; node; node = node->next) {
+            if (node->task) {
+                emit(node->task, ctx);
+                count++;
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&sched->lock);
+    return count;
+}
+
+// Clean up scheduler resources, including tasks that never became ready
+void dag_scheduler_destroy(DagScheduler* sched) {
+    if (!sched) return;
+
+    pthread_mutex_lock(&sched->lock);
+
+    for (int i = 0; i < DAG_BUCKETS; i++) {
+        DagNode* node = sched->buckets[i];
+        while (node) {
+            DagNode* next = node->next;
+            if (node->task) json_object_put(node->task);
+            free(node->dependents);
+            free(node);
+            node = next;
+        }
+    }
+
+    Dag* dag = sched->dags;
+    while (dag) {
+        Dag* next = dag->next;
+        free(dag);
+        dag = next;
+    }
+
+    for (int i = 0; i < DAG_UNTRACKED_STRIPES; i++) {
+        for (int b = 0; b < DAG_UNTRACKED_BUCKETS; b++) {
+            DagUntracked* entry = sched->untracked[i].buckets[b];
+            while (entry) {
+                DagUntracked* next = entry->next;
+                free(entry);
+                entry = next;
+            }
+        }
+        pthread_mutex_destroy(&sched->untracked[i].lock);
+    }
+
+    pthread_mutex_unlock(&sched->lock);
+    pthread_mutex_destroy(&sched->lock);
+    free(sched);
+}
@@ -0,0 +1,111 @@
+#ifndef DAG_H
+#define DAG_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <json-c/json.h>
+
+#define DAG_ID_LEN 32
+#define DAG_BUCKETS 4096
+#define DAG_MAX_RETIRED 1024   // Completed tasks kept as nodes
+#define DAG_UNTRACKED_STRIPES 64
+#define DAG_UNTRACKED_BUCKETS 256 // Per stripe
+#define DAG_DONE_KEYS 1024        // Per stripe: keys of completed tasks kept for depends_on
+#define DAG_MAX_DAGS 256       // Finished DAGs kept for status queries
+
+// Error codes returned by dag_submit_batch
+#define DAG_OK 0
+#define DAG_ERR_NOMEM -1
+#define DAG_ERR_UNKNOWN_DEP -2
+#define DAG_ERR_DUPLICATE -3
+#define DAG_ERR_CYCLE -4
+#define DAG_ERR_RESTORING -5   // Dependency may still arrive with the restored backlog
+
+// Hands a ready task to the execution queue, returns 0 on success
+typedef int (*DagDispatchFn)(struct json_object* task, int priority);
+
+// Receives a waiting task during dag_export_waiting (the scheduler keeps ownership)
+typedef void (*DagExportFn)(struct json_object* task, void* ctx);
+
+// Per-DAG completion tracking
+typedef struct Dag {
+    char dag_id[DAG_ID_LEN];
+    int total;
+    atomic_int completed;
+    struct Dag* next;
+} Dag;
+
+// A task known to the scheduler, waiting or finished
+typedef struct DagNode {
+    char task_id[DAG_ID_LEN];
+    struct json_object* task;     // Owned here until the task is dispatched
+    int priority;
+    atomic_int pending;           // Unfinished dependencies (+1 while wiring)
+    bool completed;
+    struct DagNode** dependents;  // Released when this task completes
+    int dependent_count;
+    int dependent_capacity;
+    Dag* dag;
+    struct DagNode* next;         // Hash bucket chain
+    struct DagNode* retired_next; // FIFO of completed nodes
+} DagNode;
+
+// A running task that was submitted without dependencies and bypassed the scheduler lock.
+// It only gets a DagNode if a later task comes to depend on it before it finishes.
+typedef struct DagUntracked {
+    char task_id[DAG_ID_LEN];
+    bool watched;                 // Has a node, so completion must go through the scheduler
+    struct DagUntracked* next;
+} DagUntracked;
+
+// One independently locked slice of the untracked set, with the keys (see task_id_key)
+// of recently completed tasks that hash to it
+typedef struct {
+    _Alignas(64) pthread_mutex_t lock;
+    DagUntracked* buckets[DAG_UNTRACKED_BUCKETS];
+    uint64_t done_keys[DAG_DONE_KEYS];  // Ring, oldest overwritten first
+    int done_next;
+    int done_count;
+} DagUntrackedStripe;
+
+// Scheduler state
+typedef struct DagScheduler {
+    DagUntrackedStripe untracked[DAG_UNTRACKED_STRIPES];
+    DagNode* buckets[DAG_BUCKETS];
+    DagNode* retired_head;
+    DagNode* retired_tail;
+    int retired_count;
+    Dag* dags;
+    int dag_count;
+    atomic_int waiting;
+    atomic_bool restoring;        // A predecessor's backlog has not been restored yet
+    DagDispatchFn dispatch;
+    pthread_mutex_t lock;
+} DagScheduler;
+
+// One task of a submission
+typedef struct {
+    const char* task_id;
+    struct json_object* task;
+    int priority;
+    const char** depends_on;
+    int dep_count;
+} DagTaskSpec;
+
+// Core functions
+DagScheduler* dag_scheduler_init(DagDispatchFn dispatch);
+Dag* dag_create(DagScheduler* sched, const char* dag_id, int total);
+int dag_submit_batch(DagScheduler* sched, Dag* dag, DagTaskSpec* specs, int count);
+int dag_submit_untracked(DagScheduler* sched, const char* task_id, struct json_object* task,
+                         int priority);
+void dag_task_completed(DagScheduler* sched, const char* task_id);
+int dag_get_status(DagScheduler* sched, const char* dag_id, int* total, int* completed);
+int dag_waiting_count(DagScheduler* sched);
+bool dag_has_task(DagScheduler* sched, const char* task_id);
+void dag_set_restoring(DagScheduler* sched, bool restoring);
+int dag_export_waiting(DagScheduler* sched, DagExportFn emit, void* ctx);
+void dag_scheduler_destroy(DagScheduler* sched);
+
+#endif // DAG_H
@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "dedup.h"
+
+// FNV-1a hash of a key; low bits pick the stripe, high bits the bucket
+static unsigned int hash_key(const char* key) {
+    unsigned int hash = 2166136261u;
+    while (*key) {
+        hash ^= (unsigned char)*key++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Unlink an entry from its bucket (stripe lock must be held)
+static void unlink_bucket(DedupStripe* stripe, DedupEntry* entry, unsigned int bucket) {
+    DedupEntry** link = &stripe->buckets[bucket];
+    while (*link && *link != entry) {
+        link = &(*link)->hash_next;
+    }
+    if (*link) *link = entry->hash_next;
+}
+
+// Drop the oldest entry of a stripe (stripe lock must be held)
+static void evict_oldest(DedupStripe* stripe) {
+    DedupEntry* entry = stripe->oldest;
+    stripe->oldest = entry->age_next;
+    if (!stripe->oldest) stripe->newest = NULL;
+    stripe->count--;
+
+    unlink_bucket(stripe, entry, (hash_key(entry->key) / DEDUP_STRIPES) % DEDUP_BUCKETS_PER_STRIPE);
+    free(entry);
+}
+
+// Initialize a new dedup table remembering up to `capacity` keys for `ttl` seconds
+DedupTable* dedup_init(int capacity, int ttl) {
+    DedupTable* table = (DedupTable*)aligned_alloc(64, sizeof(DedupTable));
+    if (!table) return NULL;
+
+    memset(table, 0, sizeof(DedupTable));
+    table->stripe_capacity = capacity / DEDUP_STRIPES > 0 ? capacity / DEDUP_STRIPES : 1;
+    table->ttl = ttl;
+    for (int i = 0; i < DEDUP_STRIPES; i++) {
+        pthread_mutex_init(&table->stripes[i].lock, NULL);
+    }
+    return table;
+}
+
+// Claim `key` for `task_id`. Returns 1 if the caller owns the key now, 0 if the key was
+// already used (the original task ID is copied to `existing_id`), -1 on error.
+int dedup_claim(DedupTable* table, const char* key, const char* task_id,
+                char* existing_id, size_t existing_len) {
+    if (!table || !key || strlen(key) >= DEDUP_KEY_LEN) return -1;
+
+    unsigned int hash = hash_key(key);
+    DedupStripe* stripe = &table->stripes[hash % DEDUP_STRIPES];
+    unsigned int bucket = (hash / DEDUP_STRIPES) % DEDUP_BUCKETS_PER_STRIPE;
+    time_t now = time(NULL);
+
+    pthread_mutex_lock(&stripe->lock);
+
+    // Entries share one TTL, so expired ones are always at the old end
+    while (stripe->oldest && stripe->oldest->expires <= now) {
+        evict_oldest(stripe);
+    }
+
+    for (DedupEntry* entry = stripe->buckets[bucket]; entry; entry = entry->hash_next) {
+        if (strcmp(entry->key, key) == 0) {
+            snprintf(existing_id, existing_len, "%s", entry->task_id);
+            pthread_mutex_unlock(&stripe->lock);
+            return 0;
+        }
+    }
+
+    DedupEntry* entry = (DedupEntry*)malloc(sizeof(DedupEntry));
+    if (!entry) {
+        pthread_mutex_unlock(&stripe->lock);
+        return -1;
+    }
+    strcpy(entry->key, key);
+    snprintf(entry->task_id, sizeof(entry->task_id), "%s", task_id);
+    entry->expires = now + table->ttl;
+    entry->age_next = NULL;
+
+    if (stripe->count >= table->stripe_capacity) {
+        evict_oldest(stripe);
+    }
+
+    entry->hash_next = stripe->buckets[bucket];
+    stripe->buckets[bucket] = entry;
+    if (stripe->newest) stripe->newest->age_next = entry;
+    else stripe->oldest = entry;
+    stripe->newest = entry;
+    stripe->count++;
+
+    pthread_mutex_unlock(&stripe->lock);
+    return 1;
+}
+
+// Forget a claim whose task could not be queued, so a retry can go through
+void dedup_release(DedupTable* table, const char* key, const char* task_id) {
+    if (!table || !key) return;
+
+    unsigned int hash = hash_key(key);
+    DedupStripe* stripe = &table->stripes[hash % DEDUP_STRIPES];
+    unsigned int bucket = (hash / DEDUP_STRIPES) % DEDUP_BUCKETS_PER_STRIPE;
+
+    pthread_mutex_lock(&stripe->lock);
+
+    DedupEntry* entry = stripe->buckets[bucket];
+    while (entry && (strcmp(entry->key, key) != 0 || strcmp(entry->task_id, task_id) != 0)) {
+        entry = entry->hash_next;
+    }
+    if (entry) {
+        unlink_bucket(stripe, entry, bucket);
+
+        DedupEntry** link = &stripe->oldest;
+        DedupEntry* prev = NULL;
+        while (*link != entry) {
+            prev = *link;
+            link = &(*link)->age_next;
+        }
+        *link = entry->age_next;
+        if (stripe->newest == entry) stripe->newest = prev;
+        stripe->count--;
+        free(entry);
+    }
+
+    pthread_mutex_unlock(&stripe->lock);
+}
+
+// Clean up table resources
+void dedup_destroy(DedupTable* table) {
+    if (!table) return;
+
+    for (int i = 0; i < DEDUP_STRIPES; i++) {
+        DedupStripe* stripe = &table->stripes[i];
+        pthread_mutex_lock(&stripe->lock);
+        while (stripe->oldest) {
+            evict_oldest(stripe);
+        }
+        pthread_mutex_unlock(&stripe->lock);
+        pthread_mutex_destroy(&stripe->lock);
+    }
+    free(table);
+}
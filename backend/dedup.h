@@ -0,0 +1,45 @@
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <time.h>
+
+#define DEDUP_KEY_LEN 128
+#define DEDUP_ID_LEN 32
+#define DEDUP_STRIPES 64              // Independently locked slices of the table
+#define DEDUP_BUCKETS_PER_STRIPE 256
+
+// Idempotency key mapped to the task it created
+typedef struct DedupEntry {
+    char key[DEDUP_KEY_LEN];
+    char task_id[DEDUP_ID_LEN];
+    time_t expires;
+    struct DedupEntry* hash_next;
+    struct DedupEntry* age_next;      // Insertion order, oldest first
+} DedupEntry;
+
+// One stripe: its own lock, buckets and eviction order
+typedef struct {
+    _Alignas(64) pthread_mutex_t lock;
+    DedupEntry* buckets[DEDUP_BUCKETS_PER_STRIPE];
+    DedupEntry* oldest;
+    DedupEntry* newest;
+    int count;
+} DedupStripe;
+
+// Dedup table structure
+typedef struct DedupTable {
+    DedupStripe stripes[DEDUP_STRIPES];
+    int stripe_capacity;              // Entries kept per stripe before the oldest is evicted
+    int ttl;                          // Seconds a key is remembered
+} DedupTable;
+
+// Core functions
+DedupTable* dedup_init(int capacity, int ttl);
+int dedup_claim(DedupTable* table, const char* key, const char* task_id,
+                char* existing_id, size_t existing_len);
+void dedup_release(DedupTable* table, const char* key, const char* task_id);
+void dedup_destroy(DedupTable* table);
+
+#endif // DEDUP_H
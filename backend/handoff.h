@@ -0,0 +1,20 @@
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+// Hot restart over a Unix domain socket: a new process connects to the running one,
+// receives its listening socket, and then reads the remaining backlog as JSON lines.
+
+#include <stddef.h>
+
+#define HANDOFF_FD_TIMEOUT_MS 5000      // Wait for the listening socket from the old process
+#define HANDOFF_ACK_TIMEOUT_MS 30000    // Wait for the new process to confirm the backlog
+
+// Core functions
+int handoff_listen(const char* path);
+int handoff_connect(const char* path);
+int handoff_send_fd(int sock, int fd);
+int handoff_recv_fd(int sock, int timeout_ms);
+int handoff_send_backlog(int sock, const char* data, size_t len, int timeout_ms);
+int handoff_ack(int sock);
+
+#endif // HANDOFF_H
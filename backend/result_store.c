@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "result_store.h"
+#include "task_id.h"
+
+// Bucket for a task ID
+static unsigned int hash_id(const char* id) {
+    return (unsigned int)(task_id_key(id) % RESULT_BUCKETS);
+}
+
+// Smallest size class that fits `size` bytes, or -1 if it needs a dedicated block
+static int size_class_for(size_t size) {
+    for (int cls = 0; cls < RESULT_NUM_CLASSES; cls++) {
+        if (size <= ((size_t)1 << (RESULT_MIN_SHIFT + cls))) return cls;
+    }
+    return -1;
+}
+
+// Take a block from the class free list or the system allocator (lock must be held)
+static ResultEntry* alloc_block(ResultStore* store, int cls, size_t size) {
+    if (cls >= 0 && store->free_blocks[cls]) {
+        void* block = store->free_blocks[cls];
+        store->free_blocks[cls] = *(void**)block;
+        store->free_counts[cls]--;
+        store->free_bytes -= (size_t)1 << (RESULT_MIN_SHIFT + cls);
+        return (ResultEntry*)block;
+    }
+    return (ResultEntry*)malloc(size);
+}
+
+// Return a block to its class free list, or to the system when the list is full (lock must be held)
+static void free_block(ResultStore* store, ResultEntry* entry) {
+    int cls = entry->size_class;
+    if (cls >= 0 && store->free_counts[cls] < RESULT_FREE_PER_CLASS) {
+        *(void**)entry = store->free_blocks[cls];
+        store->free_blocks[cls] = entry;
+        store->free_counts[cls]++;
+        store->free_bytes += entry->block_size;
+    } else {
+        free(entry);
+    }
+}
+
+// Give one cached block, largest class first, back to the system (lock must be held);
+// returns 0 if the free lists are empty
+static int trim_free_block(ResultStore* store) {
+    for (int cls = RESULT_NUM_CLASSES - 1; cls >= 0; cls--) {
+        void* block = store->free_blocks[cls];
+        if (block) {
+            store->free_blocks[cls] = *(void**)block;
+            store->free_counts[cls]--;
+            store->free_bytes -= (size_t)1 << (RESULT_MIN_SHIFT + cls);
+            free(block);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Drop a reference; the last one recycles the block (lock must be held)
+static void unref_locked(ResultStore* store, ResultEntry* entry) {
+    if (atomic_fetch_sub(&entry->refs, 1) == 1) {
+        free_block(store, entry);
+    }
+}
+
+// Remove an entry from the index and LRU list and drop the index reference (lock must be held)
+static void unlink_entry(ResultStore* store, ResultEntry* entry) {
+    ResultEntry** link = &store->buckets[hash_id(entry->task_id)];
+    while (*link && *link != entry) {
+        link = &(*link)->hash_next;
+    }
+    if (*link) *link = entry->hash_next;
+
+    if (entry->lru_prev) entry->lru_prev->lru_next = entry->lru_next;
+    else store->lru_head = entry->lru_next;
+    if (entry->lru_next) entry->lru_next->lru_prev = entry->lru_prev;
+    else store->lru_tail = entry->lru_prev;
+
+    store->bytes_used -= entry->block_size;
+    unref_locked(store, entry);
+}
+
+// Move an entry to the most recently used position (lock must be held)
+static void touch_entry(ResultStore* store, ResultEntry* entry) {
+    if (store->lru_head == entry) return;
+
+    entry->lru_prev->lru_next = entry->lru_next;
+    if (entry->lru_next) entry->lru_next->lru_prev = entry->lru_prev;
+    else store->lru_tail = entry->lru_prev;
+
+    entry->lru_prev = NULL;
+    entry->lru_next = store->lru_head;
+    store->lru_head->lru_prev = entry;
+    store->lru_head = entry;
+}
+
+// Find an indexed entry by task ID (lock must be held)
+static ResultEntry* find_entry(ResultStore* store, const char* task_id) {
+    ResultEntry* entry = store->buckets[hash_id(task_id)];
+    while (entry && strcmp(entry->task_id, task_id) != 0) {
+        entry = entry->hash_next;
+    }
+    return entry;
+}
+
+// Initialize a new result store
+ResultStore* result_store_init(size_t budget, int ttl) {
+    ResultStore* store = (ResultStore*)calloc(1, sizeof(ResultStore));
+    if (!store) return NULL;
+
+    store->budget = budget;
+    store->ttl = ttl;
+    pthread_mutex_init(&store->lock, NULL);
+    return store;
+}
+
+// Copy a result into the arena, dropping expired results, cached free blocks and then least
+// recently used results to stay in budget
+int result_store_put(ResultStore* store, const char* task_id, const char* data, size_t length) {
+    if (!store || !task_id) return -1;
+
+    size_t needed = offsetof(ResultEntry, data) + length;
+    int cls = size_class_for(needed);
+    size_t block_size = cls >= 0 ? ((size_t)1 << (RESULT_MIN_SHIFT + cls)) : needed;
+    if (block_size > store->budget) return -1;
+
+    pthread_mutex_lock(&store->lock);
+
+    ResultEntry* entry = alloc_block(store, cls, block_size);
+    if (!entry) {
+        pthread_mutex_unlock(&store->lock);
+        return -1;
+    }
+
+    memset(entry, 0, sizeof(ResultEntry));
+    strncpy(entry->task_id, task_id, RESULT_ID_LEN - 1);
+    entry->length = length;
+    entry->block_size = block_size;
+    entry->size_class = cls;
+    entry->created = time(NULL);
+    entry->store = store;
+    atomic_init(&entry->refs, 1);
+    memcpy(entry->data, data, length);
+
+    ResultEntry* previous = find_entry(store, task_id);
+    if (previous) unlink_entry(store, previous);
+
+    time_t cutoff = entry->created - store->ttl;
+    while (store->lru_tail && store->lru_tail->created <= cutoff) {
+        unlink_entry(store, store->lru_tail);
+    }
+    // Cached blocks go before live results
+    while (store->bytes_used + store->free_bytes + block_size > store->budget) {
+        if (!trim_free_block(store)) {
+            if (!store->lru_tail) break;
+            unlink_entry(store, store->lru_tail);
+        }
+    }
+
+    unsigned int bucket = hash_id(entry->task_id);
+    entry->hash_next = store->buckets[bucket];
+    store->buckets[bucket] = entry;
+
+    entry->lru_next = store->lru_head;
+    if (store->lru_head) store->lru_head->lru_prev = entry;
+    else store->lru_tail = entry;
+    store->lru_head = entry;
+    store->bytes_used += block_size;
+
+    pthread_mutex_unlock(&store->lock);
+    return 0;
+}
+
+// Look up a result and take a reference; release it with result_store_release(entry->data)
+ResultEntry* result_store_get(ResultStore* store, const char* task_id) {
+    if (!store || !task_id) return NULL;
+
+    pthread_mutex_lock(&store->lock);
+
+    ResultEntry* entry = find_entry(store, task_id);
+    if (entry && entry->created + store->ttl < time(NULL)) {
+        unlink_entry(store, entry);
+        entry = NULL;
+    }
+    if (entry) {
+        touch_entry(store, entry);
+        atomic_fetch_add(&entry->refs, 1);
+    }
+
+    pthread_mutex_unlock(&store->lock);
+    return entry;
+}
+
+// Drop a reference taken by result_store_get; matches MHD_ContentReaderFreeCallback
+// so a response can hand the result bytes out without copying them
+void result_store_release(void* data) {
+    if (!data) return;
+
+    ResultEntry* entry = (ResultEntry*)((char*)data - offsetof(ResultEntry, data));
+    ResultStore* store = entry->store;
+
+    pthread_mutex_lock(&store->lock);
+    unref_locked(store, entry);
+    pthread_mutex_unlock(&store->lock);
+}
+
+// Clean up store resources
+void result_store_destroy(ResultStore* store) {
+    if (!store) return;
+
+    pthread_mutex_lock(&store->lock);
+
+    while (store->lru_tail) {
+        unlink_entry(store, store->lru_tail);
+    }
+    for (int cls = 0; cls < RESULT_NUM_CLASSES; cls++) {
+        void* block = store->free_blocks[cls];
+        while (block) {
+            void* next = *(void**)block;
+            free(block);
+            block = next;
+        }
+    }
+
+    pthread_mutex_unlock(&store->lock);
+    pthread_mutex_destroy(&store->lock);
+    free(store);
+}
@@ -0,0 +1,51 @@
+#ifndef RESULT_STORE_H
+#define RESULT_STORE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <time.h>
+
+#define RESULT_ID_LEN 32
+#define RESULT_BUCKETS 4096
+#define RESULT_MIN_SHIFT 8         // Smallest size class is 256 bytes
+#define RESULT_NUM_CLASSES 13      // Largest size class is 1 MiB, bigger results get their own block
+#define RESULT_FREE_PER_CLASS 16   // Recycled blocks cached per size class
+
+// A stored result; header and bytes share one arena block
+typedef struct ResultEntry {
+    char task_id[RESULT_ID_LEN];
+    size_t length;                  // Bytes of result data
+    size_t block_size;              // Bytes charged against the budget
+    int size_class;                 // -1 for oversized dedicated blocks
+    time_t created;
+    atomic_int refs;                // Index reference + one per response in flight
+    struct ResultStore* store;
+    struct ResultEntry* hash_next;
+    struct ResultEntry* lru_prev;
+    struct ResultEntry* lru_next;
+    char data[];
+} ResultEntry;
+
+// Result store structure
+typedef struct ResultStore {
+    ResultEntry* buckets[RESULT_BUCKETS];
+    ResultEntry* lru_head;          // Most recently used
+    ResultEntry* lru_tail;          // Next eviction candidate
+    void* free_blocks[RESULT_NUM_CLASSES];
+    int free_counts[RESULT_NUM_CLASSES];
+    size_t bytes_used;              // Blocks holding indexed results
+    size_t free_bytes;              // Blocks cached on the free lists, also charged to the budget
+    size_t budget;
+    int ttl;                        // Seconds a result stays retrievable
+    pthread_mutex_t lock;
+} ResultStore;
+
+// Core functions
+ResultStore* result_store_init(size_t budget, int ttl);
+int result_store_put(ResultStore* store, const char* task_id, const char* data, size_t length);
+ResultEntry* result_store_get(ResultStore* store, const char* task_id);
+void result_store_release(void* data);
+void result_store_destroy(ResultStore* store);
+
+#endif // RESULT_STORE_H
@@ -6,15 +6,39 @@
 #include <signal.h>
 #include <unistd.h>  // Add this for usleep
 #include <time.h>    // Add this for time()
+#include <poll.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
 #include "task_queue.h"
 #include "worker.h"
+#include "dag.h"
+#include "result_store.h"
+#include "topology.h"
+#include "dedup.h"
+#include "task_id.h"
+#include "cluster.h"
+#include "handoff.h"
+#include "trace.h"
 
 #define MAX_CLIENTS 100
 #define NUM_WORKERS 2  // Number of worker threads to create
+#define MAX_DEPENDENCIES 64  // depends_on entries accepted per task
+#define MAX_DAG_TASKS 1024   // Tasks accepted per /submit_dag request
+#define MAX_TRACE_SECONDS 3600  // Longest window /debug/trace exports
 
 // Global variables
-static TaskQueue* task_queue;
+static TaskQueue* task_queues[TOPOLOGY_MAX_NODES];  // One shard per NUMA node
+static int num_queues = 0;
+static Topology* topology;
+static int num_workers = NUM_WORKERS;
+static DagScheduler* dag_scheduler;
+static ResultStore* result_store;
+static DedupTable* dedup_table;
+static Cluster* cluster = NULL;  // Set when CLUSTER_PEERS is configured
 static volatile int shutdown_requested = 0;
+static atomic_bool draining = false;  // Set once shutdown or handoff begins
 static Worker** workers = NULL;
 static int http_port;  // Added global variable
 
@@ -26,6 +50,13 @@ static void handle_sigint(int sig) {
     shutdown_requested = 1;
 }
 
+// Per-connection request state
+typedef struct {
+    char* data;     // Accumulated POST body
+    size_t size;
+    uint64_t received;  // trace_now() when the request arrived
+} RequestContext;
+
 // Store completed tasks for polling
 #define MAX_COMPLETED_TASKS 100
 static struct {
@@ -34,12 +65,14 @@ static struct {
 } completed_tasks[MAX_COMPLETED_TASKS];
 static int completed_task_count = 0;
 static int completed_task_index = 0;
+static pthread_mutex_t completed_lock = PTHREAD_MUTEX_INITIALIZER;
 
 // Function to add a completed task to the list
 void add_completed_task(const char* task_id) {
     time_t now = time(NULL);
     
     // Add to circular buffer
+    pthread_mutex_lock(&completed_lock);
     strncpy(completed_tasks[completed_task_index].task_id, task_id, 31);
     completed_tasks[completed_task_index].task_id[31] = '\0';
     completed_tasks[completed_task_index].completion_time = now;
@@ -48,8 +81,1007 @@ void add_completed_task(const char* task_id) {
     if (completed_task_count < MAX_COMPLETED_TASKS) {
         completed_task_count++;
     }
+    pthread_mutex_unlock(&completed_lock);
     
     printf("[SERVER] Task completed: %s\n", task_id);
+
+    // Release tasks that were waiting on this one
+    dag_task_completed(dag_scheduler, task_id);
+}
+
+// Keep a task's output retrievable through GET /task/{id}/result
+void store_task_result(const char* task_id, const char* data, size_t length) {
+    if (result_store_put(result_store, task_id, data, length) != 0) {
+        fprintf(stderr, "[SERVER] Failed to store result for task %s (%zu bytes)\n",
+                task_id, length);
+    }
+}
+
+// Tasks queued across all shards
+static int total_queue_size(void) {
+    int total = 0;
+    for (int i = 0; i < num_queues; i++) {
+        total += queue_size(task_queues[i]);
+    }
+    return total;
+}
+
+// Free every queue shard, including tasks still queued
+static void destroy_queues(void) {
+    for (int i = 0; i < num_queues; i++) {
+        struct json_object* task;
+        while ((task = queue_pop(task_queues[i]))) {
+            json_object_put(task);
+        }
+        queue_destroy(task_queues[i]);
+    }
+    num_queues = 0;
+}
+
+// Queue a task on the shard of the caller's NUMA node
+static int enqueue_local(struct json_object* task, int priority) {
+    struct json_object* id_obj;
+    if (json_object_object_get_ex(task, "id", &id_obj)) {
+        trace_event(json_object_get_string(id_obj), TRACE_ENQUEUE);
+    }
+    int node = topology_current_node(topology) % num_queues;
+    return queue_push(task_queues[node], task, priority);
+}
+
+// Hand a task whose dependencies are met to the queue; in cluster mode it goes
+// to the node owning its ID, and runs here if that node cannot be reached
+static int dispatch_ready_task(struct json_object* task, int priority) {
+    struct json_object* id_obj;
+    if (cluster && json_object_object_get_ex(task, "id", &id_obj)) {
+        const char* task_id = json_object_get_string(id_obj);
+        int owner = cluster_owner(cluster, task_id);
+        if (owner != cluster->self) {
+            int forwarded = cluster_forward(cluster, owner, task);
+            if (forwarded == CLUSTER_FORWARD_OK) {
+                json_object_put(task);
+                return 0;
+            }
+            if (forwarded == CLUSTER_FORWARD_UNCONFIRMED) {
+                // The peer may have queued it despite the missing OK; running it here
+                // can execute it twice, which is preferred over losing it
+                fprintf(stderr, "[SERVER] Node %d did not confirm %s, running it locally "
+                        "(possible duplicate execution)\n", owner, task_id);
+            } else {
+                fprintf(stderr, "[SERVER] Node %d unreachable, running %s locally\n", owner, task_id);
+            }
+        }
+    }
+    return enqueue_local(task, priority);
+}
+
+// Pull a queued task from a busy peer when this node has nothing to do
+struct json_object* fetch_remote_task(void) {
+    if (!cluster || atomic_load(&draining)) return NULL;
+    return cluster_steal(cluster);
+}
+
+// Tell the node that scheduled a task (see origin_node) that it finished here
+void report_remote_completion(int origin_node, const char* task_id) {
+    if (cluster && origin_node != cluster->self) {
+        cluster_report_done(cluster, origin_node, task_id);
+    }
+}
+
+// Cluster hook: take back a task a peer did not acknowledge stealing; this works while
+// draining too, since the task was ours all along
+static int cluster_requeue(struct json_object* task) {
+    struct json_object* priority_obj;
+    int priority = 1;
+    if (json_object_object_get_ex(task, "priority", &priority_obj)) {
+        priority = json_object_get_int(priority_obj);
+    }
+    return enqueue_local(task, priority);
+}
+
+// Cluster hook: queue a task a peer routed to this node. Refused while draining, so the
+// peer keeps the task and runs it itself.
+static int cluster_enqueue(struct json_object* task) {
+    if (atomic_load(&draining)) return -1;
+    return cluster_requeue(task);
+}
+
+// Cluster hook: hand one of our queued tasks to an idle peer (not while draining, as the
+// backlog is about to be drained or saved)
+static struct json_object* cluster_give_task(void) {
+    if (atomic_load(&draining)) return NULL;
+    for (int i = 0; i < num_queues; i++) {
+        struct json_object* task = queue_pop(task_queues[i]);
+        if (task) return task;
+    }
+    return NULL;
+}
+
+// Cluster hook: a task scheduled here finished on a peer
+static void cluster_task_done(const char* task_id) {
+    dag_task_completed(dag_scheduler, task_id);
+}
+
+// Completed tasks recorded on this node, newest first
+static struct json_object* local_completed_tasks(time_t since_time) {
+    struct json_object *tasks_array = json_object_new_array();
+
+    pthread_mutex_lock(&completed_lock);
+    for (int i = 0; i < completed_task_count; i++) {
+        int idx = (completed_task_index - 1 - i + MAX_COMPLETED_TASKS) % MAX_COMPLETED_TASKS;
+        
+        // Skip tasks completed before the 'since' time
+        if (since_time > 0 && completed_tasks[idx].completion_time <= since_time) {
+            continue;
+        }
+        
+        struct json_object *task = json_object_new_object();
+        json_object_object_add(task, "id", json_object_new_string(completed_tasks[idx].task_id));
+        json_object_object_add(task, "completion_time", json_object_new_int64(completed_tasks[idx].completion_time));
+        json_object_object_add(task, "node", json_object_new_int((int)task_id_node()));
+        json_object_array_add(tasks_array, task);
+    }
+    pthread_mutex_unlock(&completed_lock);
+
+    return tasks_array;
+}
+
+// Cluster hook: local queue depth
+static void local_stats(int* queued, int* waiting) {
+    *queued = total_queue_size();
+    *waiting = dag_waiting_count(dag_scheduler);
+}
+
+static char* cluster_submit_request(const char* kind, const char* body, int* status);
+
+static const ClusterHandlers cluster_handlers = {
+    .enqueue = cluster_enqueue,
+    .steal = cluster_give_task,
+    .requeue = cluster_requeue,
+    .task_done = cluster_task_done,
+    .stats = local_stats,
+    .completed = local_completed_tasks,
+    .submit = cluster_submit_request,
+};
+
+// Write one task as a line of the backlog
+static void write_task_line(struct json_object* task, void* ctx) {
+    fprintf((FILE*)ctx, "%s\n", json_object_to_json_string_ext(task, JSON_C_TO_STRING_PLAIN));
+}
+
+// Move every task that has not run into `out` as JSON lines: queued tasks first, then
+// tasks still waiting on dependencies. Workers must already be stopped.
+static int write_backlog(FILE* out) {
+    int count = 0;
+    for (int i = 0; i < num_queues; i++) {
+        struct json_object* task;
+        while ((task = queue_pop(task_queues[i]))) {
+            write_task_line(task, out);
+            json_object_put(task);
+            count++;
+        }
+    }
+    count += dag_export_waiting(dag_scheduler, write_task_line, out);
+    fflush(out);
+    return count;
+}
+
+// Serialize the backlog into memory first, so a failed handoff can still be saved.
+// Returns a malloc'd buffer, or NULL if it could not be built.
+static char* collect_backlog(size_t* size, int* count) {
+    char* data = NULL;
+    *size = 0;
+    *count = 0;
+
+    FILE* out = open_memstream(&data, size);
+    if (!out) return NULL;
+
+    *count = write_backlog(out);
+    int failed = ferror(out);
+    if (fclose(out) != 0 || failed) {
+        free(data);
+        return NULL;
+    }
+    return data;
+}
+
+// Write a serialized backlog to `path` atomically; returns 0 on success
+static int save_backlog(const char* path, const char* data, size_t size) {
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE* out = fopen(tmp_path, "w");
+    if (!out) return -1;
+
+    size_t written = fwrite(data, 1, size, out);
+    int failed = ferror(out) || written != size;
+    if (fclose(out) != 0 || failed || rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+// Keep backlog entries that could not be queued in `path`, or report them lost
+static void reject_backlog_task(struct json_object* task, const char* path) {
+    FILE* out = path ? fopen(path, "a") : NULL;
+    if (out) {
+        write_task_line(task, out);
+        fclose(out);
+    }
+    fprintf(stderr, "[SERVER] Could not restore task %s%s%s\n",
+            json_object_to_json_string_ext(task, JSON_C_TO_STRING_PLAIN),
+            out ? ", kept in " : "", out ? path : "");
+    json_object_put(task);
+}
+
+// Point depends_on entries naming `old_id` at `new_id`
+static void rename_dependency(struct json_object** tasks, int count,
+                              const char* old_id, const char* new_id) {
+    for (int i = 0; i < count; i++) {
+        struct json_object* depends_obj;
+        if (!json_object_object_get_ex(tasks[i], "depends_on", &depends_obj) ||
+            !json_object_is_type(depends_obj, json_type_array)) {
+            continue;
+        }
+        for (size_t d = 0; d < json_object_array_length(depends_obj); d++) {
+            const char* dep = json_object_get_string(json_object_array_get_idx(depends_obj, d));
+            if (dep && strcmp(dep, old_id) == 0) {
+                json_object_array_put_idx(depends_obj, d, json_object_new_string(new_id));
+            }
+        }
+    }
+}
+
+// Give backlog tasks whose ID is already taken here a fresh one. The old process
+// may have used the same NODE_ID, so its counters can overlap with ours.
+static void rename_conflicting_tasks(struct json_object** tasks, int count) {
+    for (int i = 0; i < count; i++) {
+        struct json_object* id_obj;
+        json_object_object_get_ex(tasks[i], "id", &id_obj);
+        const char* task_id = json_object_get_string(id_obj);
+
+        bool repeated = false;
+        for (int j = 0; j < i && !repeated; j++) {
+            struct json_object* other;
+            json_object_object_get_ex(tasks[j], "id", &other);
+            repeated = strcmp(json_object_get_string(other), task_id) == 0;
+        }
+        if (!repeated && !dag_has_task(dag_scheduler, task_id)) continue;
+
+        char old_id[DAG_ID_LEN], new_id[DAG_ID_LEN];
+        snprintf(old_id, sizeof(old_id), "%s", task_id);
+        task_id_format("task", task_id_next(), new_id);
+        json_object_object_add(tasks[i], "id", json_object_new_string(new_id));
+        // Edges inside the backlog meant the backlog's task, not the one already here
+        if (!repeated) rename_dependency(tasks, count, old_id, new_id);
+        printf("[SERVER] Restored task %s as %s (ID already in use)\n", old_id, new_id);
+    }
+}
+
+// Submit tasks one at a time in dependency order after a batch was refused; a task
+// runs only once the backlog tasks it depends on were accepted. Returns the number queued.
+static int submit_backlog_tasks(DagTaskSpec* specs, int count, const char* reject_path) {
+    bool* done = calloc(count, sizeof(bool));
+    if (!done) return 0;
+
+    int restored = 0;
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        for (int i = 0; i < count; i++) {
+            if (done[i]) continue;
+
+            bool ready = true;
+            for (int d = 0; d < specs[i].dep_count && ready; d++) {
+                ready = dag_has_task(dag_scheduler, specs[i].depends_on[d]);
+                for (int j = 0; j < count && ready; j++) {
+                    if (!done[j] && strcmp(specs[j].task_id, specs[i].depends_on[d]) == 0) ready = false;
+                }
+            }
+            if (!ready) continue;
+
+            done[i] = true;
+            progress = true;
+            if (dag_submit_batch(dag_scheduler, NULL, &specs[i], 1) == DAG_OK) {
+                restored++;
+            } else {
+                reject_backlog_task(specs[i].task, reject_path);
+            }
+        }
+    }
+
+    // Left over: cycles or dependents of rejected tasks
+    for (int i = 0; i < count; i++) {
+        if (!done[i]) reject_backlog_task(specs[i].task, reject_path);
+    }
+    free(done);
+    return restored;
+}
+
+// Resubmit tasks written by write_backlog; returns the number restored. Dependencies
+// outside the backlog finished in the previous process, so only edges between backlog
+// tasks are kept. Entries that cannot be queued go to reject_path (if set).
+static int restore_backlog(FILE* in, const char* reject_path) {
+    struct json_object** tasks = NULL;
+    int count = 0, capacity = 0;
+    char* line = NULL;
+    size_t line_capacity = 0;
+
+    while (getline(&line, &line_capacity, in) > 0) {
+        struct json_object* task = json_tokener_parse(line);
+        struct json_object* id_obj;
+        if (!task || !json_object_object_get_ex(task, "id", &id_obj) ||
+            strlen(json_object_get_string(id_obj)) >= DAG_ID_LEN) {
+            fprintf(stderr, "[SERVER] Skipping malformed backlog entry\n");
+            json_object_put(task);
+            continue;
+        }
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            struct json_object** grown = realloc(tasks, sizeof(*tasks) * capacity);
+            if (!grown) {
+                reject_backlog_task(task, reject_path);
+                break;
+            }
+            tasks = grown;
+        }
+        tasks[count++] = task;
+    }
+    free(line);
+    if (count == 0) {
+        free(tasks);
+        return 0;
+    }
+
+    rename_conflicting_tasks(tasks, count);
+
+    int total_deps = 0;
+    for (int i = 0; i < count; i++) {
+        struct json_object* depends_obj;
+        if (json_object_object_get_ex(tasks[i], "depends_on", &depends_obj) &&
+            json_object_is_type(depends_obj, json_type_array)) {
+            total_deps += (int)json_object_array_length(depends_obj);
+        }
+    }
+
+    DagTaskSpec* specs = calloc(count, sizeof(DagTaskSpec));
+    const char** deps = calloc(total_deps > 0 ? total_deps : 1, sizeof(const char*));
+    if (!specs || !deps) {
+        for (int i = 0; i < count; i++) reject_backlog_task(tasks[i], reject_path);
+        free(specs);
+        free(deps);
+        free(tasks);
+        return 0;
+    }
+
+    for (int i = 0; i < count; i++) {
+        struct json_object *id_obj, *priority_obj;
+        json_object_object_get_ex(tasks[i], "id", &id_obj);
+        specs[i].task_id = json_object_get_string(id_obj);
+        specs[i].task = tasks[i];
+        specs[i].priority = json_object_object_get_ex(tasks[i], "priority", &priority_obj)
+                                ? json_object_get_int(priority_obj) : 1;
+    }
+
+    const char** next_dep = deps;
+    for (int i = 0; i < count; i++) {
+        struct json_object* depends_obj;
+        specs[i].depends_on = next_dep;
+        if (!json_object_object_get_ex(tasks[i], "depends_on", &depends_obj) ||
+            !json_object_is_type(depends_obj, json_type_array)) {
+            continue;
+        }
+        for (size_t d = 0; d < json_object_array_length(depends_obj); d++) {
+            const char* dep = json_object_get_string(json_object_array_get_idx(depends_obj, d));
+            for (int j = 0; dep && j < count; j++) {
+                if (strcmp(specs[j].task_id, dep) == 0) {
+                    specs[i].depends_on[specs[i].dep_count++] = dep;
+                    next_dep++;
+                    break;
+                }
+            }
+        }
+    }
+
+    int restored = count;
+    int result = dag_submit_batch(dag_scheduler, NULL, specs, count);
+    if (result != DAG_OK) {
+        fprintf(stderr, "[SERVER] Backlog batch refused (error %d), restoring tasks one by one\n", result);
+        restored = submit_backlog_tasks(specs, count, reject_path);
+    }
+
+    free(specs);
+    free(deps);
+    free(tasks);
+    return restored;
+}
+
+// Path that keeps backlog entries which could not be restored, or NULL
+static const char* reject_path_for(const char* backlog_path, char* buf, size_t size) {
+    if (!backlog_path) return NULL;
+    snprintf(buf, size, "%s.failed", backlog_path);
+    return buf;
+}
+
+// Load a backlog saved by a previous run and remove the file once it is queued
+static void load_backlog(const char* path) {
+    FILE* in = fopen(path, "r");
+    if (!in) return;
+
+    char reject_buf[PATH_MAX];
+    int restored = restore_backlog(in, reject_path_for(path, reject_buf, sizeof(reject_buf)));
+    fclose(in);
+
+    unlink(path);
+    printf("Restored %d tasks from %s\n", restored, path);
+}
+
+// Read the backlog the previous process sends once its in-flight tasks are done and
+// confirm it; without the confirmation the old process saves the backlog itself.
+// The socket stays open for main() to shut down and close.
+static void* restore_from_predecessor(void* arg) {
+    int sock = (int)(intptr_t)arg;
+    int read_fd = dup(sock);
+    FILE* in = read_fd >= 0 ? fdopen(read_fd, "r") : NULL;
+    if (!in) {
+        if (read_fd >= 0) close(read_fd);
+        dag_set_restoring(dag_scheduler, false);
+        return NULL;
+    }
+
+    char reject_buf[PATH_MAX];
+    int restored = restore_backlog(in, reject_path_for(getenv("BACKLOG_FILE"), reject_buf,
+                                                       sizeof(reject_buf)));
+    fclose(in);
+    dag_set_restoring(dag_scheduler, false);
+
+    if (handoff_ack(sock) != 0) {
+        fprintf(stderr, "Failed to confirm backlog to previous process\n");
+    }
+    printf("Restored %d tasks from previous process\n", restored);
+    return NULL;
+}
+
+// Keep workers running until nothing is queued, waiting or in flight, or the deadline passes
+static bool drain_tasks(int timeout_seconds) {
+    time_t deadline = time(NULL) + timeout_seconds;
+    while (time(NULL) < deadline) {
+        if (total_queue_size() == 0 && dag_waiting_count(dag_scheduler) == 0 &&
+            worker_pool_idle(workers, num_workers)) {
+            return true;
+        }
+        usleep(100000);
+    }
+    return false;
+}
+
+// Pin and name the calling connection thread once. MHD's connection notification runs on
+// the listener thread, so this is done from the first request the thread handles.
+static _Thread_local bool http_thread_ready = false;
+static void prepare_http_thread(void) {
+    if (http_thread_ready) return;
+    http_thread_ready = true;
+    topology_place_http_thread(topology);
+    trace_set_thread_name("http");
+}
+
+// Generate a collision-free ID such as task_0a1b2c3d4e5f6789
+static void generate_id(const char* prefix, char* buf) {
+    task_id_format(prefix, task_id_next(), buf);
+}
+
+// Free per-connection request state once MHD is done with the request
+static void request_completed(void *cls, struct MHD_Connection *connection,
+                              void **con_cls, enum MHD_RequestTerminationCode toe) {
+    RequestContext* ctx = *con_cls;
+    if (!ctx) return;
+
+    free(ctx->data);
+    free(ctx);
+    *con_cls = NULL;
+}
+
+// Where a submit handler's response goes
+typedef struct {
+    struct MHD_Connection* connection;  // NULL for a request forwarded by a peer
+    int status;                         // Response kept for the peer
+    char* body;
+} SubmitReply;
+
+// Queue a JSON response with the frontend CORS header
+static enum MHD_Result send_json(struct MHD_Connection *connection,
+                                 unsigned int status, const char* body) {
+    struct MHD_Response *response = MHD_create_response_from_buffer(strlen(body),
+                                                                    (void*)body,
+                                                                    MHD_RESPMEM_MUST_COPY);
+    MHD_add_response_header(response, "Content-Type", "application/json");
+    MHD_add_response_header(response, "Access-Control-Allow-Origin", "https://thread-flow.vercel.app");
+    enum MHD_Result ret = MHD_queue_response(connection, status, response);
+    MHD_destroy_response(response);
+    return ret;
+}
+
+// Answer a submit: to the HTTP client, or kept for the peer that forwarded the request
+static enum MHD_Result reply_json(SubmitReply* reply, unsigned int status, const char* body) {
+    if (reply->connection) return send_json(reply->connection, status, body);
+
+    reply->status = (int)status;
+    reply->body = strdup(body);
+    return reply->body ? MHD_YES : MHD_NO;
+}
+
+// Map a scheduler error to an HTTP response
+static enum MHD_Result reply_dag_error(SubmitReply* reply, int err) {
+    switch (err) {
+        case DAG_ERR_UNKNOWN_DEP:
+            return reply_json(reply, MHD_HTTP_BAD_REQUEST, "{\"error\":\"Unknown dependency\"}");
+        case DAG_ERR_CYCLE:
+            return reply_json(reply, MHD_HTTP_BAD_REQUEST, "{\"error\":\"Dependency cycle\"}");
+        case DAG_ERR_RESTORING:
+            return reply_json(reply, MHD_HTTP_SERVICE_UNAVAILABLE,
+                              "{\"error\":\"Dependency not restored yet, retry shortly\"}");
+        default:
+            return reply_json(reply, MHD_HTTP_INTERNAL_SERVER_ERROR,
+                              "{\"error\":\"Failed to add task to queue\"}");
+    }
+}
+
+// Cluster node whose scheduler tracks a task: the node bits of its ID, since NODE_ID is
+// the cluster index. IDs that are not ours to route count as local.
+static int task_home_node(const char* task_id) {
+    uint64_t id;
+    if (task_id_parse(task_id, &id) != 0) return cluster->self;
+
+    int node = (int)((id >> TASK_ID_SEQ_BITS) & TASK_ID_MAX_NODE);
+    return node < cluster->num_nodes ? node : cluster->self;
+}
+
+// Fold one dependency into the node that has to run a submit; -1 once dependencies
+// are tracked on different nodes. Start with `home` at -2 (no dependency yet).
+static int merge_home_node(int home, const char* task_id) {
+    int node = task_home_node(task_id);
+    if (home == -2 || home == node) return node;
+    return -1;
+}
+
+// Run a submit on the node that tracks its dependencies and relay that node's answer
+static enum MHD_Result forward_submit(SubmitReply* reply, const char* kind,
+                                      struct json_object* request, const char* idempotency_key,
+                                      int node) {
+    if (idempotency_key && idempotency_key[0]) {
+        json_object_object_add(request, "idempotency_key", json_object_new_string(idempotency_key));
+    }
+
+    int status;
+    bool sent;
+    char* body = cluster_submit(cluster, node, kind,
+                                json_object_to_json_string_ext(request, JSON_C_TO_STRING_PLAIN),
+                                &status, &sent);
+    if (!body) {
+        fprintf(stderr, "[SERVER] Failed to forward %s submit to node %d\n", kind, node);
+        return reply_json(reply, MHD_HTTP_BAD_GATEWAY, sent
+            ? "{\"error\":\"Node tracking the dependencies did not answer, retry with the same Idempotency-Key\"}"
+            : "{\"error\":\"Node tracking the dependencies is unreachable\"}");
+    }
+
+    printf("[SERVER] Forwarded %s submit to node %d, which tracks its dependencies\n", kind, node);
+    enum MHD_Result ret = reply_json(reply, (unsigned int)status, body);
+    free(body);
+    return ret;
+}
+
+// Collect the string IDs of an optional depends_on array; returns -1 if malformed
+static int parse_depends_on(struct json_object *request, struct json_object **depends_obj,
+                            const char **deps, int max_deps) {
+    *depends_obj = NULL;
+    if (!json_object_object_get_ex(request, "depends_on", depends_obj)) return 0;
+    if (!json_object_is_type(*depends_obj, json_type_array)) return -1;
+
+    int count = (int)json_object_array_length(*depends_obj);
+    if (count > max_deps) return -1;
+
+    for (int i = 0; i < count; i++) {
+        struct json_object *dep = json_object_array_get_idx(*depends_obj, i);
+        if (!json_object_is_type(dep, json_type_string)) return -1;
+        deps[i] = json_object_get_string(dep);
+    }
+    return count;
+}
+
+// Build the task object handed to the workers
+static struct json_object* create_task(const char* task_id, struct json_object *data_obj,
+                                       struct json_object *priority_obj,
+                                       const char **deps, int dep_count) {
+    struct json_object *task = json_object_new_object();
+    json_object_object_add(task, "id", json_object_new_string(task_id));
+    json_object_object_add(task, "data", json_object_get(data_obj));
+    json_object_object_add(task, "priority", json_object_get(priority_obj));
+    json_object_object_add(task, "status", json_object_new_string("pending"));
+
+    if (dep_count > 0) {
+        struct json_object *deps_array = json_object_new_array();
+        for (int i = 0; i < dep_count; i++) {
+            json_object_array_add(deps_array, json_object_new_string(deps[i]));
+        }
+        json_object_object_add(task, "depends_on", deps_array);
+    }
+    return task;
+}
+
+// POST /submit: queue a single task, optionally gated on depends_on
+static enum MHD_Result handle_submit(SubmitReply* reply, const char* body, uint64_t received) {
+    struct json_object *request = json_tokener_parse(body);
+    struct json_object *data_obj, *priority_obj, *depends_obj;
+    const char *deps[MAX_DEPENDENCIES];
+    int dep_count = -1;
+
+    if (request &&
+        json_object_object_get_ex(request, "data", &data_obj) &&
+        json_object_object_get_ex(request, "priority", &priority_obj)) {
+        dep_count = parse_depends_on(request, &depends_obj, deps, MAX_DEPENDENCIES);
+    }
+    if (dep_count < 0) {
+        json_object_put(request);
+        return reply_json(reply, MHD_HTTP_BAD_REQUEST, "{\"error\":\"Invalid task\"}");
+    }
+
+    // Idempotency key from the header, or from the body as a fallback
+    const char *key = reply->connection
+        ? MHD_lookup_connection_value(reply->connection, MHD_HEADER_KIND, "Idempotency-Key") : NULL;
+    struct json_object *key_obj;
+    if (!key && json_object_object_get_ex(request, "idempotency_key", &key_obj)) {
+        key = json_object_get_string(key_obj);
+    }
+    char idempotency_key[DEDUP_KEY_LEN] = "";
+    if (key) {
+        if (strlen(key) == 0 || strlen(key) >= DEDUP_KEY_LEN) {
+            json_object_put(request);
+            return reply_json(reply, MHD_HTTP_BAD_REQUEST, "{\"error\":\"Invalid idempotency key\"}");
+        }
+        strcpy(idempotency_key, key);
+    }
+
+    // In a cluster the node tracking the dependencies runs the submit and assigns the ID
+    if (cluster && reply->connection) {
+        int home = -2;
+        for (int i = 0; i < dep_count; i++) home = merge_home_node(home, deps[i]);
+        if (home == -1) {
+            json_object_put(request);
+            return reply_json(reply, MHD_HTTP_BAD_REQUEST,
+                              "{\"error\":\"Dependencies are tracked on different cluster nodes\"}");
+        }
+        if (home >= 0 && home != cluster->self) {
+            enum MHD_Result ret = forward_submit(reply, "task", request, idempotency_key, home);
+            json_object_put(request);
+            return ret;
+        }
+    }
+
+    char task_id[32];
+    generate_id("task", task_id);
+
+    // A retried submit gets the original task ID back instead of queueing again
+    if (idempotency_key[0]) {
+        char existing_id[DEDUP_ID_LEN];
+        int claimed = dedup_claim(dedup_table, idempotency_key, task_id,
+                                  existing_id, sizeof(existing_id));
+        if (claimed == 0) {
+            printf("[SERVER] Duplicate submit for key %s, returning %s\n", idempotency_key, existing_id);
+            json_object_put(request);
+
+            struct json_object* response_obj = json_object_new_object();
+            json_object_object_add(response_obj, "status", json_object_new_string("success"));
+            json_object_object_add(response_obj, "task_id", json_object_new_string(existing_id));
+            json_object_object_add(response_obj, "duplicate", json_object_new_boolean(1));
+            enum MHD_Result ret = reply_json(reply, MHD_HTTP_OK, json_object_to_json_string(response_obj));
+            json_object_put(response_obj);
+            return ret;
+        }
+        if (claimed < 0) {
+            json_object_put(request);
+            return reply_json(reply, MHD_HTTP_INTERNAL_SERVER_ERROR,
+                             "{\"error\":\"Failed to add task to queue\"}");
+        }
+    }
+
+    DagTaskSpec spec = {
+        .task_id = task_id,
+        .task = create_task(task_id, data_obj, priority_obj, deps, dep_count),
+        .priority = json_object_get_int(priority_obj),
+        .depends_on = deps,
+        .dep_count = dep_count,
+    };
+    // Log before submitting; once accepted the task may already be running
+    printf("[SERVER] Task submitted: %s\n", json_object_to_json_string(spec.task));
+    trace_event_at(task_id, TRACE_RECEIVE, received);
+
+    // Tasks without dependencies skip the scheduler lock
+    int err = dep_count == 0
+                  ? dag_submit_untracked(dag_scheduler, task_id, spec.task, spec.priority)
+                  : dag_submit_batch(dag_scheduler, NULL, &spec, 1);
+    json_object_put(request);
+    if (err != DAG_OK) {
+        if (idempotency_key[0]) dedup_release(dedup_table, idempotency_key, task_id);
+        json_object_put(spec.task);
+        return reply_dag_error(reply, err);
+    }
+
+    // Create success response with task ID
+    struct json_object* response_obj = json_object_new_object();
+    json_object_object_add(response_obj, "status", json_object_new_string("success"));
+    json_object_object_add(response_obj, "task_id", json_object_new_string(task_id));
+    enum MHD_Result ret = reply_json(reply, MHD_HTTP_OK, json_object_to_json_string(response_obj));
+    json_object_put(response_obj);
+    return ret;
+}
+
+// Node that has to run a DAG: merge_home_node over every dependency that does not name
+// a task of the DAG itself
+static int dag_home_node(struct json_object* tasks_obj, int count) {
+    int home = -2;
+    for (int i = 0; i < count && home != -1; i++) {
+        struct json_object* depends_obj;
+        struct json_object* entry = json_object_array_get_idx(tasks_obj, i);
+        if (!json_object_object_get_ex(entry, "depends_on", &depends_obj) ||
+            !json_object_is_type(depends_obj, json_type_array)) {
+            continue;
+        }
+        for (size_t d = 0; d < json_object_array_length(depends_obj) && home != -1; d++) {
+            const char* dep = json_object_get_string(json_object_array_get_idx(depends_obj, d));
+            bool internal = false;
+            for (int j = 0; j < count && dep && !internal; j++) {
+                struct json_object* name_obj;
+                struct json_object* other = json_object_array_get_idx(tasks_obj, j);
+                internal = json_object_object_get_ex(other, "name", &name_obj) &&
+                           strcmp(json_object_get_string(name_obj), dep) == 0;
+            }
+            if (dep && !internal) home = merge_home_node(home, dep);
+        }
+    }
+    return home;
+}
+
+// POST /submit_dag: queue a whole pipeline in one request.
+// Body: {"tasks":[{"name":"fetch","data":...,"priority":1,"depends_on":["..."]}, ...]}
+// depends_on entries name tasks of the same DAG or IDs of earlier tasks.
+static enum MHD_Result handle_submit_dag(SubmitReply* reply, const char* body, uint64_t received) {
+    struct json_object *request = json_tokener_parse(body);
+    struct json_object *tasks_obj;
+    if (!request || !json_object_object_get_ex(request, "tasks", &tasks_obj) ||
+        !json_object_is_type(tasks_obj, json_type_array) ||
+        json_object_array_length(tasks_obj) == 0 ||
+        json_object_array_length(tasks_obj) > MAX_DAG_TASKS) {
+        json_object_put(request);
+        return reply_json(reply, MHD_HTTP_BAD_REQUEST, "{\"error\":\"Invalid DAG\"}");
+    }
+
+    int count = (int)json_object_array_length(tasks_obj);
+
+    // Dependencies outside the DAG decide which cluster node runs it, as for /submit
+    if (cluster && reply->connection) {
+        int home = dag_home_node(tasks_obj, count);
+        if (home == -1) {
+            json_object_put(request);
+            return reply_json(reply, MHD_HTTP_BAD_REQUEST,
+                              "{\"error\":\"Dependencies are tracked on different cluster nodes\"}");
+        }
+        if (home >= 0 && home != cluster->self) {
+            enum MHD_Result ret = forward_submit(reply, "dag", request, NULL, home);
+            json_object_put(request);
+            return ret;
+        }
+    }
+    DagTaskSpec *specs = calloc(count, sizeof(DagTaskSpec));
+    char (*ids)[32] = calloc(count, sizeof(*ids));
+    const char **names = calloc(count, sizeof(char*));
+    const char **deps = calloc((size_t)count * MAX_DEPENDENCIES, sizeof(char*));
+    if (!specs || !ids || !names || !deps) {
+        free(specs); free(ids); free(names); free(deps);
+        json_object_put(request);
+        return reply_json(reply, MHD_HTTP_INTERNAL_SERVER_ERROR,
+                         "{\"error\":\"Failed to add task to queue\"}");
+    }
+
+    // Assign IDs first so depends_on can refer to tasks later in the array
+    bool valid = true;
+    for (int i = 0; i < count; i++) {
+        struct json_object *entry = json_object_array_get_idx(tasks_obj, i);
+        struct json_object *name_obj;
+        generate_id("task", ids[i]);
+        if (json_object_object_get_ex(entry, "name", &name_obj)) {
+            names[i] = json_object_get_string(name_obj);
+        }
+    }
+
+    for (int i = 0; i < count && valid; i++) {
+        struct json_object *entry = json_object_array_get_idx(tasks_obj, i);
+        struct json_object *data_obj, *priority_obj, *depends_obj;
+        const char **task_deps = deps + (size_t)i * MAX_DEPENDENCIES;
+
+        if (!json_object_object_get_ex(entry, "data", &data_obj) ||
+            !json_object_object_get_ex(entry, "priority", &priority_obj)) {
+            valid = false;
+            break;
+        }
+        int dep_count = parse_depends_on(entry, &depends_obj, task_deps, MAX_DEPENDENCIES);
+        if (dep_count < 0) {
+            valid = false;
+            break;
+        }
+
+        // Resolve names within this DAG to their task IDs
+        for (int d = 0; d < dep_count; d++) {
+            for (int j = 0; j < count; j++) {
+                if (names[j] && strcmp(names[j], task_deps[d]) == 0) {
+                    task_deps[d] = ids[j];
+                    break;
+                }
+            }
+        }
+
+        specs[i].task_id = ids[i];
+        specs[i].task = create_task(ids[i], data_obj, priority_obj, task_deps, dep_count);
+        specs[i].priority = json_object_get_int(priority_obj);
+        specs[i].depends_on = task_deps;
+        specs[i].dep_count = dep_count;
+    }
+
+    char dag_id[32];
+    generate_id("dag", dag_id);
+    Dag *dag = valid ? dag_create(dag_scheduler, dag_id, count) : NULL;
+    for (int i = 0; i < count && dag; i++) {
+        trace_event_at(ids[i], TRACE_RECEIVE, received);
+    }
+    int err = dag ? dag_submit_batch(dag_scheduler, dag, specs, count) : DAG_ERR_NOMEM;
+
+    enum MHD_Result ret;
+    if (!valid) {
+        ret = reply_json(reply, MHD_HTTP_BAD_REQUEST, "{\"error\":\"Invalid task\"}");
+    } else if (err != DAG_OK) {
+        ret = reply_dag_error(reply, err);
+    } else {
+        printf("[SERVER] DAG %s submitted with %d tasks\n", dag_id, count);
+
+        struct json_object *ids_array = json_object_new_array();
+        for (int i = 0; i < count; i++) {
+            json_object_array_add(ids_array, json_object_new_string(ids[i]));
+        }
+        struct json_object* response_obj = json_object_new_object();
+        json_object_object_add(response_obj, "status", json_object_new_string("success"));
+        json_object_object_add(response_obj, "dag_id", json_object_new_string(dag_id));
+        json_object_object_add(response_obj, "task_ids", ids_array);
+        ret = reply_json(reply, MHD_HTTP_OK, json_object_to_json_string(response_obj));
+        json_object_put(response_obj);
+    }
+
+    // The scheduler owns the tasks only when the batch was accepted
+    if (err != DAG_OK) {
+        for (int i = 0; i < count; i++) {
+            if (specs[i].task) json_object_put(specs[i].task);
+        }
+        free(dag);
+    }
+    free(specs); free(ids); free(names); free(deps);
+    json_object_put(request);
+    return ret;
+}
+
+// Cluster hook: run a submit a peer forwarded because this node tracks its dependencies.
+// Returns the response body (caller frees) and its HTTP status.
+static char* cluster_submit_request(const char* kind, const char* body, int* status) {
+    SubmitReply reply = { .connection = NULL };
+    if (atomic_load(&draining)) {
+        reply_json(&reply, MHD_HTTP_SERVICE_UNAVAILABLE, "{\"error\":\"Node is shutting down\"}");
+    } else if (strcmp(kind, "task") == 0) {
+        handle_submit(&reply, body, trace_now());
+    } else if (strcmp(kind, "dag") == 0) {
+        handle_submit_dag(&reply, body, trace_now());
+    } else {
+        reply_json(&reply, MHD_HTTP_BAD_REQUEST, "{\"error\":\"Unknown submit kind\"}");
+    }
+    *status = reply.status;
+    return reply.body;
+}
+
+// GET /dag/{id}: completion progress of a submitted DAG
+static enum MHD_Result handle_dag_status(struct MHD_Connection *connection, const char* dag_id) {
+    int total, completed;
+    if (dag_get_status(dag_scheduler, dag_id, &total, &completed) != 0) {
+        return send_json(connection, MHD_HTTP_NOT_FOUND, "{\"error\":\"Not Found\"}");
+    }
+
+    struct json_object* response_obj = json_object_new_object();
+    json_object_object_add(response_obj, "dag_id", json_object_new_string(dag_id));
+    json_object_object_add(response_obj, "total", json_object_new_int(total));
+    json_object_object_add(response_obj, "completed", json_object_new_int(completed));
+    json_object_object_add(response_obj, "status",
+                           json_object_new_string(completed >= total ? "completed" : "running"));
+    enum MHD_Result ret = send_json(connection, MHD_HTTP_OK, json_object_to_json_string(response_obj));
+    json_object_put(response_obj);
+    return ret;
+}
+
+// GET /task/{id}/result: serve a stored result straight from the arena.
+// The response borrows the arena block and drops its reference once sent.
+static enum MHD_Result handle_task_result(struct MHD_Connection *connection, const char* task_id) {
+    ResultEntry* entry = result_store_get(result_store, task_id);
+    if (!entry) {
+        return send_json(connection, MHD_HTTP_NOT_FOUND, "{\"error\":\"Result not found\"}");
+    }
+
+    struct MHD_Response *response = MHD_create_response_from_buffer_with_free_callback(
+        entry->length, entry->data, &result_store_release);
+    if (!response) {
+        result_store_release(entry->data);
+        return MHD_NO;
+    }
+    MHD_add_response_header(response, "Content-Type", "application/json");
+    MHD_add_response_header(response, "Access-Control-Allow-Origin", "https://thread-flow.vercel.app");
+    enum MHD_Result ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+    MHD_destroy_response(response);
+    return ret;
+}
+
+// Newest completion first when merging nodes' lists
+static int compare_completion_desc(const void* a, const void* b) {
+    struct json_object *ta = *(struct json_object* const*)a, *tb = *(struct json_object* const*)b;
+    struct json_object *ca, *cb;
+    json_object_object_get_ex(ta, "completion_time", &ca);
+    json_object_object_get_ex(tb, "completion_time", &cb);
+    int64_t x = json_object_get_int64(ca), y = json_object_get_int64(cb);
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+// GET /tasks in cluster mode: queue depth of every node plus the totals
+static enum MHD_Result handle_cluster_tasks(struct MHD_Connection *connection) {
+    struct json_object *nodes = json_object_new_array();
+    int total_queued = 0, total_waiting = 0;
+
+    for (int node = 0; node < cluster->num_nodes; node++) {
+        int queued = 0, waiting = 0;
+        bool reachable = true;
+        if (node == cluster->self) {
+            local_stats(&queued, &waiting);
+        } else {
+            reachable = cluster_peer_stats(cluster, node, &queued, &waiting) == 0;
+        }
+        total_queued += queued;
+        total_waiting += waiting;
+
+        struct json_object *entry = json_object_new_object();
+        json_object_object_add(entry, "node", json_object_new_int(node));
+        json_object_object_add(entry, "tasks", json_object_new_int(queued));
+        json_object_object_add(entry, "waiting", json_object_new_int(waiting));
+        json_object_object_add(entry, "reachable", json_object_new_boolean(reachable));
+        json_object_array_add(nodes, entry);
+    }
+
+    struct json_object *response_obj = json_object_new_object();
+    json_object_object_add(response_obj, "tasks", json_object_new_int(total_queued));
+    json_object_object_add(response_obj, "waiting", json_object_new_int(total_waiting));
+    json_object_object_add(response_obj, "nodes", nodes);
+    enum MHD_Result ret = send_json(connection, MHD_HTTP_OK, json_object_to_json_string(response_obj));
+    json_object_put(response_obj);
+    return ret;
+}
+
+// GET /debug/trace: Chrome trace-event JSON (chrome://tracing, Perfetto) of the
+// tasks traced in the last `seconds` seconds (default 10)
+static enum MHD_Result handle_debug_trace(struct MHD_Connection *connection) {
+    const char *seconds_str = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "seconds");
+    int seconds = seconds_str ? atoi(seconds_str) : 10;
+    if (seconds <= 0 || seconds > MAX_TRACE_SECONDS) {
+        return send_json(connection, MHD_HTTP_BAD_REQUEST, "{\"error\":\"Invalid seconds\"}");
+    }
+
+    struct json_object* trace = trace_export(seconds);
+    if (!trace) {
+        return send_json(connection, MHD_HTTP_INTERNAL_SERVER_ERROR, "{\"error\":\"Trace export failed\"}");
+    }
+    enum MHD_Result ret = send_json(connection, MHD_HTTP_OK,
+                                    json_object_to_json_string_ext(trace, JSON_C_TO_STRING_PLAIN));
+    json_object_put(trace);
+    return ret;
 }
 
 // HTTP request handler
@@ -57,117 +1089,86 @@ static enum MHD_Result handle_request(void *cls, struct MHD_Connection *connecti
                                     const char *url, const char *method,
                                     const char *version, const char *upload_data,
                                     size_t *upload_data_size, void **con_cls) {
-    static int dummy;
     struct MHD_Response *response;
     enum MHD_Result ret;
-    static char *request_data = NULL;
-    static size_t request_data_size = 0;
 
     // First call handling
     if (*con_cls == NULL) {
-        *con_cls = &dummy;
+        prepare_http_thread();
+        RequestContext* ctx = calloc(1, sizeof(RequestContext));
+        if (!ctx) return MHD_NO;
+        ctx->received = trace_now();
+        *con_cls = ctx;
         return MHD_YES;
     }
+    RequestContext* ctx = *con_cls;
 
     // Handle CORS preflight requests
     if (strcmp(method, "OPTIONS") == 0) {
         response = MHD_create_response_from_buffer(0, NULL, MHD_RESPMEM_PERSISTENT);
         MHD_add_response_header(response, "Access-Control-Allow-Origin", "https://thread-flow.vercel.app");
         MHD_add_response_header(response, "Access-Control-Allow-Methods", "POST, GET, OPTIONS");
-        MHD_add_response_header(response, "Access-Control-Allow-Headers", "Content-Type");
+        MHD_add_response_header(response, "Access-Control-Allow-Headers", "Content-Type, Idempotency-Key");
         MHD_add_response_header(response, "Access-Control-Max-Age", "86400");
         ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
         MHD_destroy_response(response);
         return ret;
     }
 
+    // Accumulate POST bodies into the per-connection buffer
+    if (strcmp(method, "POST") == 0 && *upload_data_size != 0) {
+        char *new_data = realloc(ctx->data, ctx->size + *upload_data_size + 1);
+        if (!new_data) return MHD_NO;
+        ctx->data = new_data;
+        memcpy(ctx->data + ctx->size, upload_data, *upload_data_size);
+        ctx->size += *upload_data_size;
+        ctx->data[ctx->size] = '\0';
+        *upload_data_size = 0;
+        return MHD_YES;
+    }
+
     // Handle POST request for task submission
     if (strcmp(method, "POST") == 0 && strcmp(url, "/submit") == 0) {
-        if (*upload_data_size != 0) {
-            // Accumulate request data
-            char *new_data = realloc(request_data, request_data_size + *upload_data_size + 1);
-            if (!new_data) {
-                free(request_data);
-                return MHD_NO;
-            }
-            request_data = new_data;
-            memcpy(request_data + request_data_size, upload_data, *upload_data_size);
-            request_data_size += *upload_data_size;
-            request_data[request_data_size] = '\0';
-            *upload_data_size = 0;
-            return MHD_YES;
-        }
-
-        // Process the complete request
-        if (request_data) {
-            struct json_object *request = json_tokener_parse(request_data);
-            if (request) {
-                struct json_object *data_obj, *priority_obj;
-                if (json_object_object_get_ex(request, "data", &data_obj) &&
-                    json_object_object_get_ex(request, "priority", &priority_obj)) {
-                    
-                    // Generate a unique task ID using timestamp and random number
-                    char task_id[32];
-                    snprintf(task_id, sizeof(task_id), "task_%ld_%d", 
-                            time(NULL), rand() % 1000);
-                    
-                    // Create task object with proper ID
-                    struct json_object *task = json_object_new_object();
-                    json_object_object_add(task, "id", json_object_new_string(task_id));
-                    json_object_object_add(task, "data", json_object_get(data_obj));
-                    json_object_object_add(task, "priority", json_object_get(priority_obj));
-                    json_object_object_add(task, "status", json_object_new_string("pending"));
-                    
-                    // Add to queue
-                    int priority = json_object_get_int(priority_obj);
-                    if (queue_push(task_queue, task, priority) == 0) {
-                        printf("[SERVER] Task added to queue: %s\n", 
-                               json_object_to_json_string(task));
-                        
-                        // Create success response with task ID
-                        struct json_object* response_obj = json_object_new_object();
-                        json_object_object_add(response_obj, "status", 
-                                             json_object_new_string("success"));
-                        json_object_object_add(response_obj, "task_id", 
-                                             json_object_new_string(task_id));
-                        
-                        const char* response_str = json_object_to_json_string(response_obj);
-                        response = MHD_create_response_from_buffer(strlen(response_str), 
-                                                                 (void*)response_str,
-                                                                 MHD_RESPMEM_MUST_COPY);
-                        MHD_add_response_header(response, "Content-Type", "application/json");
-                        MHD_add_response_header(response, "Access-Control-Allow-Origin", "https://thread-flow.vercel.app");
-                        ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
-                        MHD_destroy_response(response);
-                        json_object_put(response_obj);
-                    } else {
-                        // Queue error response
-                        const char *error = "{\"error\":\"Failed to add task to queue\"}";
-                        response = MHD_create_response_from_buffer(strlen(error),
-                                                                 (void*)error,
-                                                                 MHD_RESPMEM_PERSISTENT);
-                        MHD_add_response_header(response, "Content-Type", "application/json");
-                        MHD_add_response_header(response, "Access-Control-Allow-Origin", "https://thread-flow.vercel.app");
-                        ret = MHD_queue_response(connection, MHD_HTTP_INTERNAL_SERVER_ERROR, response);
-                        MHD_destroy_response(response);
-                    }
-                }
-                json_object_put(request);
-            }
-            
-            // Cleanup
-            free(request_data);
-            request_data = NULL;
-            request_data_size = 0;
-            
-            return ret;
+        SubmitReply reply = { .connection = connection };
+        return handle_submit(&reply, ctx->data ? ctx->data : "", ctx->received);
+    }
+
+    // Handle POST request for pipeline submission
+    if (strcmp(method, "POST") == 0 && strcmp(url, "/submit_dag") == 0) {
+        SubmitReply reply = { .connection = connection };
+        return handle_submit_dag(&reply, ctx->data ? ctx->data : "", ctx->received);
+    }
+
+    // Task result endpoint: /task/{id}/result
+    if (strcmp(method, "GET") == 0 && strncmp(url, "/task/", 6) == 0) {
+        const char *suffix = strchr(url + 6, '/');
+        size_t id_len = suffix ? (size_t)(suffix - (url + 6)) : 0;
+        if (suffix && strcmp(suffix, "/result") == 0 && id_len > 0 && id_len < RESULT_ID_LEN) {
+            char task_id[RESULT_ID_LEN];
+            memcpy(task_id, url + 6, id_len);
+            task_id[id_len] = '\0';
+            return handle_task_result(connection, task_id);
         }
     }
 
+    // Lifecycle trace of recent tasks: /debug/trace?seconds=N
+    if (strcmp(method, "GET") == 0 && strcmp(url, "/debug/trace") == 0) {
+        return handle_debug_trace(connection);
+    }
+
+    // DAG progress endpoint
+    if (strcmp(method, "GET") == 0 && strncmp(url, "/dag/", 5) == 0) {
+        return handle_dag_status(connection, url + 5);
+    }
+
     // Handle GET request
     if (strcmp(method, "GET") == 0 && strcmp(url, "/tasks") == 0) {
-        char buf[32];
-        snprintf(buf, sizeof(buf), "{\"tasks\":%d}", queue_size(task_queue));
+        if (cluster) {
+            return handle_cluster_tasks(connection);
+        }
+        char buf[64];
+        snprintf(buf, sizeof(buf), "{\"tasks\":%d,\"waiting\":%d}",
+                 total_queue_size(), dag_waiting_count(dag_scheduler));
         response = MHD_create_response_from_buffer(strlen(buf), 
                                                  buf,
                                                  MHD_RESPMEM_MUST_COPY);
@@ -207,9 +1208,6 @@ static enum MHD_Result handle_request(void *cls, struct MHD_Connection *connecti
 
     // New endpoint for polling completed tasks
     if (strcmp(method, "GET") == 0 && strcmp(url, "/completed_tasks") == 0) {
-        // Create JSON array of completed tasks
-        struct json_object *tasks_array = json_object_new_array();
-        
         // Get the 'since' parameter if provided
         const char *since_str = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "since");
         time_t since_time = 0;
@@ -217,19 +1215,22 @@ static enum MHD_Result handle_request(void *cls, struct MHD_Connection *connecti
             since_time = (time_t)atol(since_str);
         }
         
-        // Add completed tasks to the array
-        for (int i = 0; i < completed_task_count; i++) {
-            int idx = (completed_task_index - 1 - i + MAX_COMPLETED_TASKS) % MAX_COMPLETED_TASKS;
-            
-            // Skip tasks completed before the 'since' time
-            if (since_time > 0 && completed_tasks[idx].completion_time <= since_time) {
-                continue;
+        // Create JSON array of completed tasks
+        struct json_object *tasks_array = local_completed_tasks(since_time);
+        
+        // In cluster mode merge in every reachable peer's list
+        if (cluster) {
+            for (int node = 0; node < cluster->num_nodes; node++) {
+                if (node == cluster->self) continue;
+                struct json_object *peer_tasks = cluster_peer_completed(cluster, node, since_time);
+                if (!peer_tasks) continue;
+                for (size_t i = 0; i < json_object_array_length(peer_tasks); i++) {
+                    json_object_array_add(tasks_array,
+                                          json_object_get(json_object_array_get_idx(peer_tasks, i)));
+                }
+                json_object_put(peer_tasks);
             }
-            
-            struct json_object *task = json_object_new_object();
-            json_object_object_add(task, "id", json_object_new_string(completed_tasks[idx].task_id));
-            json_object_object_add(task, "completion_time", json_object_new_int64(completed_tasks[idx].completion_time));
-            json_object_array_add(tasks_array, task);
+            json_object_array_sort(tasks_array, compare_completion_desc);
         }
         
         // Create response object
@@ -271,22 +1272,140 @@ static int get_port(const char* env_var, int default_port) {
     return default_port;
 }
 
+// Read a positive integer setting from the environment
+static int get_env_int(const char* env_var, int default_value) {
+    const char* value_str = getenv(env_var);
+    if (value_str) {
+        int value = atoi(value_str);
+        return value > 0 ? value : default_value;
+    }
+    return default_value;
+}
+
 int main() {
-    // Initialize task queue
-    task_queue = queue_init();
-    if (!task_queue) {
-        fprintf(stderr, "Failed to initialize task queue\n");
+    // Node ID keeps task IDs unique across ThreadFlow processes
+    const char* node_str = getenv("NODE_ID");
+    int node_id = node_str ? atoi(node_str) : 0;
+    if (node_id < 0 || node_id > TASK_ID_MAX_NODE) {
+        fprintf(stderr, "NODE_ID must be between 0 and %d\n", TASK_ID_MAX_NODE);
+        return 1;
+    }
+    task_id_init((unsigned int)node_id);
+
+    // Trace 1 in TRACE_SAMPLE_RATE tasks; 0 turns tracing off
+    const char* sample_str = getenv("TRACE_SAMPLE_RATE");
+    trace_init(sample_str ? atoi(sample_str) : 1);
+    trace_set_thread_name("main");
+
+    // Detect CPU/NUMA layout and placement settings
+    topology = topology_init();
+    if (!topology) {
+        fprintf(stderr, "Failed to initialize topology\n");
         return 1;
     }
 
+    // Initialize task queues, one shard per node in NUMA mode
+    int shards = topology->numa ? topology->num_nodes : 1;
+    for (num_queues = 0; num_queues < shards; num_queues++) {
+        task_queues[num_queues] = queue_init_sharded(get_env_int("QUEUE_SHARDS", 0));
+        if (!task_queues[num_queues]) {
+            fprintf(stderr, "Failed to initialize task queue\n");
+            destroy_queues();
+            topology_destroy(topology);
+            return 1;
+        }
+    }
+    // Every node gets at least one worker
+    if (num_workers < shards) num_workers = shards;
+
+    // Initialize dependency scheduler
+    dag_scheduler = dag_scheduler_init(dispatch_ready_task);
+    if (!dag_scheduler) {
+        fprintf(stderr, "Failed to initialize DAG scheduler\n");
+        destroy_queues();
+        topology_destroy(topology);
+        return 1;
+    }
+
+    // Initialize result store (budget in MiB, TTL in seconds)
+    result_store = result_store_init((size_t)get_env_int("RESULT_MEMORY_MB", 64) << 20,
+                                     get_env_int("RESULT_TTL", 300));
+    if (!result_store) {
+        fprintf(stderr, "Failed to initialize result store\n");
+        dag_scheduler_destroy(dag_scheduler);
+        destroy_queues();
+        topology_destroy(topology);
+        return 1;
+    }
+
+    // Initialize idempotency key table
+    dedup_table = dedup_init(get_env_int("IDEMPOTENCY_CAPACITY", 65536),
+                             get_env_int("IDEMPOTENCY_TTL", 600));
+    if (!dedup_table) {
+        fprintf(stderr, "Failed to initialize idempotency table\n");
+        result_store_destroy(result_store);
+        dag_scheduler_destroy(dag_scheduler);
+        destroy_queues();
+        topology_destroy(topology);
+        return 1;
+    }
+
+    // Join the cluster when peers are configured; NODE_ID is our index in the list
+    const char* cluster_peers = getenv("CLUSTER_PEERS");
+    if (cluster_peers) {
+        cluster = cluster_init(cluster_peers, node_id, &cluster_handlers);
+        if (!cluster) {
+            fprintf(stderr, "Failed to join cluster\n");
+            dedup_destroy(dedup_table);
+            result_store_destroy(result_store);
+            dag_scheduler_destroy(dag_scheduler);
+            destroy_queues();
+            topology_destroy(topology);
+            return 1;
+        }
+    }
+
+    // Hot restart: take over the listening socket of a running process, if there is one
+    const char* handoff_path = getenv("HANDOFF_SOCKET");
+    if (handoff_path && cluster) {
+        fprintf(stderr, "HANDOFF_SOCKET is not supported in cluster mode, ignoring\n");
+        handoff_path = NULL;
+    }
+    int predecessor = handoff_path ? handoff_connect(handoff_path) : -1;
+    int inherited_fd = -1;
+    if (predecessor >= 0) {
+        inherited_fd = handoff_recv_fd(predecessor, HANDOFF_FD_TIMEOUT_MS);
+        if (inherited_fd < 0) {
+            fprintf(stderr, "Failed to receive listening socket from previous process\n");
+            close(predecessor);
+            predecessor = -1;
+        }
+    }
+    // Requests are served before the predecessor's backlog arrives; dependencies on
+    // tasks it still holds must not be mistaken for unknown ones
+    if (predecessor >= 0) dag_set_restoring(dag_scheduler, true);
+
     // Create worker pool
-    workers = create_worker_pool(task_queue, NUM_WORKERS);
+    workers = create_worker_pool(task_queues, num_queues, topology, num_workers);
     if (!workers) {
         fprintf(stderr, "Failed to create worker pool\n");
-        queue_destroy(task_queue);
+        if (predecessor >= 0) close(predecessor);
+        if (inherited_fd >= 0) close(inherited_fd);
+        cluster_destroy(cluster);
+        dedup_destroy(dedup_table);
+        result_store_destroy(result_store);
+        dag_scheduler_destroy(dag_scheduler);
+        destroy_queues();
+        topology_destroy(topology);
         return 1;
     }
 
+    // Requeue tasks persisted by a previous drain
+    const char* backlog_path = getenv("BACKLOG_FILE");
+    if (backlog_path) {
+        load_backlog(backlog_path);
+    }
+
     // Get port numbers from environment or use defaults
     // Use PORT env var for HTTP (Render requirement)
     http_port = get_port("PORT", 8081);
@@ -313,16 +1432,34 @@ int main() {
         }
     }
 
-    // Start HTTP server with port binding retry logic
+    // Start HTTP server on the inherited socket, or with port binding retry logic.
+    // MHD_USE_ITC lets a later hot restart quiesce the daemon.
     struct MHD_Daemon *daemon = NULL;
     int retry_count = 0;
     const int max_retries = 3;
 
+    if (inherited_fd >= 0) {
+        daemon = MHD_start_daemon(
+            MHD_USE_THREAD_PER_CONNECTION | MHD_USE_ITC,
+            0, NULL, NULL,
+            &handle_request, NULL,
+            MHD_OPTION_LISTEN_SOCKET, (MHD_socket)inherited_fd,
+            MHD_OPTION_NOTIFY_COMPLETED, &request_completed, NULL,
+            MHD_OPTION_END);
+        if (daemon) {
+            printf("Took over listening socket from previous process\n");
+        } else {
+            fprintf(stderr, "Failed to serve the inherited socket\n");
+            close(inherited_fd);
+        }
+    }
+
     while (!daemon && retry_count < max_retries) {
         daemon = MHD_start_daemon(
-            MHD_USE_THREAD_PER_CONNECTION,
+            MHD_USE_THREAD_PER_CONNECTION | MHD_USE_ITC,
             http_port, NULL, NULL,
             &handle_request, NULL,
+            MHD_OPTION_NOTIFY_COMPLETED, &request_completed, NULL,
             MHD_OPTION_END);
 
         if (!daemon) {
@@ -336,31 +1473,150 @@ int main() {
     if (!daemon) {
         fprintf(stderr, "Failed to start HTTP server after %d attempts\n", max_retries);
         fprintf(stderr, "Set HTTP_PORT environment variable to specify an alternative port.\n");
-        queue_destroy(task_queue);
+        if (predecessor >= 0) close(predecessor);
+        destroy_worker_pool(workers, num_workers);
+        cluster_destroy(cluster);
+        dag_scheduler_destroy(dag_scheduler);
+        dedup_destroy(dedup_table);
+        result_store_destroy(result_store);
+        destroy_queues();
+        topology_destroy(topology);
         return 1;
     }
 
     printf("Server started successfully:\n");
     printf("HTTP server running on port %d\n", http_port);
 
+    // The previous process sends its backlog once its in-flight tasks are done
+    pthread_t restore_thread;
+    bool restoring = false;
+    if (predecessor >= 0) {
+        restoring = pthread_create(&restore_thread, NULL, restore_from_predecessor,
+                                   (void*)(intptr_t)predecessor) == 0;
+        if (!restoring) {
+            close(predecessor);
+            predecessor = -1;
+            dag_set_restoring(dag_scheduler, false);
+        }
+    }
+
+    // Wait for the next generation on the handoff socket
+    int handoff_listener = -1;
+    if (handoff_path) {
+        handoff_listener = handoff_listen(handoff_path);
+        if (handoff_listener < 0) {
+            fprintf(stderr, "Failed to listen on handoff socket %s\n", handoff_path);
+        }
+    }
+
     // Register signal handler for graceful shutdown
     signal(SIGINT, handle_sigint);
+    signal(SIGTERM, handle_sigint);
+    // A peer or successor that went away must not kill us mid-write
+    signal(SIGPIPE, SIG_IGN);
     
     printf("Press Ctrl+C to stop the server\n");
     
     // Main event loop
-    while (!shutdown_requested) {
-        // Just sleep, no WebSocket service needed
-        usleep(10000);  // 10ms sleep to reduce CPU usage
+    int successor = -1;
+    while (!shutdown_requested && successor < 0) {
+        if (handoff_listener >= 0) {
+            struct pollfd pfd = { .fd = handoff_listener, .events = POLLIN };
+            if (poll(&pfd, 1, 10) > 0) {
+                successor = accept(handoff_listener, NULL, NULL);
+            }
+        } else {
+            usleep(10000);  // 10ms sleep to reduce CPU usage
+        }
     }
+    if (handoff_listener >= 0) close(handoff_listener);
     
-    printf("Shutting down server...\n");
+    atomic_store(&draining, true);
     
-    // Cleanup
-    if (daemon) MHD_stop_daemon(daemon);
+    // Stop accepting: on hot restart the listening socket moves to the new process,
+    // otherwise it is closed. Either way open requests are answered first.
+    if (successor >= 0) {
+        printf("Handing off to new process...\n");
+        MHD_socket listen_fd = MHD_quiesce_daemon(daemon);
+        if (listen_fd == MHD_INVALID_SOCKET || handoff_send_fd(successor, listen_fd) != 0) {
+            fprintf(stderr, "Failed to pass listening socket, draining instead\n");
+            close(successor);
+            successor = -1;
+        }
+        MHD_stop_daemon(daemon);
+        if (listen_fd != MHD_INVALID_SOCKET) close(listen_fd);
+    } else {
+        printf("Shutting down server...\n");
+        MHD_stop_daemon(daemon);
+    }
+    
+    // Stop waiting for a predecessor's backlog; without our confirmation it saves it itself
+    if (restoring) {
+        shutdown(predecessor, SHUT_RDWR);
+        pthread_join(restore_thread, NULL);
+        close(predecessor);
+    }
+    
+    // Drain: keep processing the backlog until the deadline; a successor takes it over instead
+    if (successor < 0) {
+        int timeout = get_env_int("DRAIN_TIMEOUT", 30);
+        if (!drain_tasks(timeout)) {
+            printf("Drain deadline of %d seconds passed with %d queued and %d waiting tasks\n",
+                   timeout, total_queue_size(), dag_waiting_count(dag_scheduler));
+        }
+    }
+    
+    // No peer may queue or take tasks past this point, so the backlog below is complete
+    cluster_stop(cluster);
+
+    // Stop taking tasks and let in-flight ones finish
+    destroy_worker_pool(workers, num_workers);
+    workers = NULL;
     
-    destroy_worker_pool(workers, NUM_WORKERS);
-    queue_destroy(task_queue);
+    // Whatever has not run goes to the successor, or to the backlog file when there is
+    // none or the handoff is not confirmed
+    if (successor >= 0 || backlog_path) {
+        size_t size;
+        int count;
+        char* data = collect_backlog(&size, &count);
+        bool handed = false;
+
+        if (!data) {
+            fprintf(stderr, "Failed to serialize the backlog, %d tasks lost\n", count);
+        } else if (successor >= 0) {
+            handed = handoff_send_backlog(successor, data, size, HANDOFF_ACK_TIMEOUT_MS) == 0;
+            if (handed) {
+                printf("Handed %d tasks to new process\n", count);
+            } else {
+                fprintf(stderr, "New process did not confirm the backlog of %d tasks\n", count);
+            }
+        }
+
+        if (data && !handed && count > 0) {
+            if (backlog_path && save_backlog(backlog_path, data, size) == 0) {
+                printf("Saved %d tasks to %s\n", count, backlog_path);
+            } else {
+                fprintf(stderr, "Dropping %d unfinished tasks (%s)\n", count,
+                        backlog_path ? "failed to write BACKLOG_FILE" : "set BACKLOG_FILE to keep them");
+            }
+        }
+        free(data);
+        if (successor >= 0) close(successor);
+    } else {
+        int dropped = total_queue_size() + dag_waiting_count(dag_scheduler);
+        if (dropped > 0) {
+            printf("Dropping %d unfinished tasks (set BACKLOG_FILE to keep them)\n", dropped);
+        }
+    }
+    
+    // Cleanup
+    cluster_destroy(cluster);
+    dag_scheduler_destroy(dag_scheduler);
+    dedup_destroy(dedup_table);
+    result_store_destroy(result_store);
+    destroy_queues();
+    topology_destroy(topology);
+    trace_destroy();
     
     printf("Server shutdown complete\n");
     return 0;
@@ -0,0 +1,101 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include "task_id.h"
+
+// Last reserved (timestamp << TASK_ID_SEQ_BITS | sequence), shared by all threads
+static atomic_uint_fast64_t last_reserved;
+static unsigned int node = 0;
+
+// Block of sequence numbers owned by the calling thread
+static _Thread_local uint64_t block_next = 0;
+static _Thread_local uint64_t block_end = 0;
+
+// Milliseconds since the ID epoch
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t ms = (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+    return ms > TASK_ID_EPOCH_MS ? ms - TASK_ID_EPOCH_MS : 0;
+}
+
+// Set the node ID mixed into every generated ID (call before generating IDs)
+void task_id_init(unsigned int node_id) {
+    node = node_id & TASK_ID_MAX_NODE;
+}
+
+// Node ID in use
+unsigned int task_id_node(void) {
+    return node;
+}
+
+// Next unique ID. Threads reserve small blocks from a shared lock-free counter that never
+// goes below the wall clock, so IDs stay unique even if the clock steps back, and carry
+// on into the next millisecond when more than 4096 are needed within one.
+uint64_t task_id_next(void) {
+    if (block_next == block_end) {
+        uint64_t floor = now_ms() << TASK_ID_SEQ_BITS;
+        uint64_t old = atomic_load_explicit(&last_reserved, memory_order_relaxed);
+        uint64_t base;
+        do {
+            base = old > floor ? old : floor;
+        } while (!atomic_compare_exchange_weak_explicit(&last_reserved, &old, base + TASK_ID_BLOCK,
+                                                        memory_order_relaxed, memory_order_relaxed));
+        block_next = base;
+        block_end = base + TASK_ID_BLOCK;
+    }
+
+    uint64_t value = block_next++;
+    uint64_t timestamp = value >> TASK_ID_SEQ_BITS;
+    uint64_t sequence = value & ((1ULL << TASK_ID_SEQ_BITS) - 1);
+    return (timestamp << (TASK_ID_NODE_BITS + TASK_ID_SEQ_BITS)) |
+           ((uint64_t)node << TASK_ID_SEQ_BITS) | sequence;
+}
+
+// Write "<prefix>_<16 hex digits>" into buf (a prefix of up to 4 chars fits TASK_ID_STR_LEN)
+void task_id_format(const char* prefix, uint64_t id, char* buf) {
+    static const char digits[] = "0123456789abcdef";
+
+    size_t len = strlen(prefix);
+    memcpy(buf, prefix, len);
+    buf[len++] = '_';
+    for (int i = TASK_ID_HEX_LEN - 1; i >= 0; i--) {
+        buf[len + i] = digits[id & 0xf];
+        id >>= 4;
+    }
+    buf[len + TASK_ID_HEX_LEN] = '\0';
+}
+
+// Parse an ID produced by task_id_format; returns 0 on success
+int task_id_parse(const char* str, uint64_t* id) {
+    const char* sep = str ? strchr(str, '_') : NULL;
+    if (!sep || strlen(sep + 1) != TASK_ID_HEX_LEN) return -1;
+
+    uint64_t value = 0;
+    for (const char* p = sep + 1; *p; p++) {
+        int digit;
+        if (*p >= '0' && *p <= '9') digit = *p - '0';
+        else if (*p >= 'a' && *p <= 'f') digit = *p - 'a' + 10;
+        else return -1;
+        value = (value << 4) | (uint64_t)digit;
+    }
+    *id = value;
+    return 0;
+}
+
+// Integer key for indexing by ID; foreign strings fall back to an FNV-1a hash
+uint64_t task_id_key(const char* str) {
+    uint64_t id;
+    if (task_id_parse(str, &id) == 0) {
+        // Sequence and node bits vary fastest; mix the timestamp in for bucket spread
+        return id ^ (id >> 29);
+    }
+
+    uint64_t hash = 14695981039346656037ULL;
+    while (*str) {
+        hash ^= (unsigned char)*str++;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
@@ -0,0 +1,23 @@
+#ifndef TASK_ID_H
+#define TASK_ID_H
+
+#include <stdint.h>
+
+// 64-bit task IDs: [42 bits ms since TASK_ID_EPOCH_MS][10 bits node][12 bits sequence]
+#define TASK_ID_EPOCH_MS 1704067200000ULL   // 2024-01-01T00:00:00Z
+#define TASK_ID_NODE_BITS 10
+#define TASK_ID_SEQ_BITS 12
+#define TASK_ID_MAX_NODE ((1 << TASK_ID_NODE_BITS) - 1)
+#define TASK_ID_BLOCK 16                    // Sequence numbers a thread reserves at once
+#define TASK_ID_HEX_LEN 16
+#define TASK_ID_STR_LEN 22                  // "task_" + 16 hex digits + NUL
+
+// Core functions
+void task_id_init(unsigned int node_id);
+unsigned int task_id_node(void);
+uint64_t task_id_next(void);
+void task_id_format(const char* prefix, uint64_t id, char* buf);
+int task_id_parse(const char* str, uint64_t* id);
+uint64_t task_id_key(const char* str);
+
+#endif // TASK_ID_H
@@ -1,21 +1,77 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <pthread.h>
+#include <unistd.h>
 #include "task_queue.h"
 
-// Initialize a new task queue
+// Producer threads are spread round-robin over shards; unsigned so the counter wraps
+// cleanly and a slot can never be negative
+static atomic_uint next_thread_slot;
+static _Thread_local bool thread_slot_set = false;
+static _Thread_local unsigned int thread_slot = 0;
+static _Thread_local unsigned int thread_rng = 0;
+
+// Stable per-thread index used to pick a producer shard
+static unsigned int current_thread_slot(void) {
+    if (!thread_slot_set) {
+        thread_slot = atomic_fetch_add_explicit(&next_thread_slot, 1, memory_order_relaxed);
+        thread_slot_set = true;
+    }
+    return thread_slot;
+}
+
+// Per-thread xorshift generator for sampling shards
+static unsigned int next_random(void) {
+    if (thread_rng == 0) {
+        thread_rng = 2654435761u * (current_thread_slot() + 1);
+        if (thread_rng == 0) thread_rng = 1;
+    }
+    thread_rng ^= thread_rng << 13;
+    thread_rng ^= thread_rng >> 17;
+    thread_rng ^= thread_rng << 5;
+    return thread_rng;
+}
+
+// Head priority published for lock-free sampling; INT_MAX is reserved for "empty"
+static int priority_hint(int priority) {
+    return priority < QUEUE_EMPTY_PRIORITY ? priority : QUEUE_EMPTY_PRIORITY - 1;
+}
+
+// Initialize a new task queue with one shard per online CPU
 TaskQueue* queue_init() {
+    return queue_init_sharded(0);
+}
+
+// Initialize a new task queue split into `num_shards` shards (0 = one per online CPU)
+TaskQueue* queue_init_sharded(int num_shards) {
+    if (num_shards <= 0) num_shards = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_shards < 1) num_shards = 1;
+    if (num_shards > QUEUE_MAX_SHARDS) num_shards = QUEUE_MAX_SHARDS;
+
     TaskQueue* queue = (TaskQueue*)malloc(sizeof(TaskQueue));
     if (!queue) return NULL;
 
-    queue->head = NULL;
-    queue->tail = NULL;
-    queue->size = 0;
-    pthread_mutex_init(&queue->lock, NULL);
+    queue->shards = (TaskQueueShard*)aligned_alloc(QUEUE_CACHE_LINE,
+                                                   sizeof(TaskQueueShard) * num_shards);
+    if (!queue->shards) {
+        free(queue);
+        return NULL;
+    }
+
+    for (int i = 0; i < num_shards; i++) {
+        TaskQueueShard* shard = &queue->shards[i];
+        shard->head = NULL;
+        shard->tail = NULL;
+        atomic_init(&shard->head_priority, QUEUE_EMPTY_PRIORITY);
+        pthread_mutex_init(&shard->lock, NULL);
+    }
+    queue->num_shards = num_shards;
+    atomic_init(&queue->size, 0);
     return queue;
 }
 
-// Add a task to the queue (with priority)
+// Add a task to the calling thread's shard (with priority)
 int queue_push(TaskQueue* queue, void* data, int priority) {
     if (!queue) return -1;
 
@@ -26,22 +82,23 @@ int queue_push(TaskQueue* queue, void* data, int priority) {
     new_task->priority = priority;
     new_task->next = NULL;
 
-    pthread_mutex_lock(&queue->lock);
+    TaskQueueShard* shard = &queue->shards[current_thread_slot() % (unsigned int)queue->num_shards];
+    pthread_mutex_lock(&shard->lock);
 
     // Empty queue case
-    if (!queue->head) {
-        queue->head = queue->tail = new_task;
+    if (!shard->head) {
+        shard->head = shard->tail = new_task;
     } else {
         // Priority insertion
-        if (priority < queue->head->priority) {
+        if (priority < shard->head->priority) {
             // Insert at head
-            new_task->next = queue->head;
-            queue->head = new_task;
+            new_task->next = shard->head;
+            shard->head = new_task;
         } else {
             // Find insertion point
-            Task* current = queue->head;
+            Task* current = shard->head;
             Task* prev = NULL;
-            
+
             while (current && current->priority <= priority) {
                 prev = current;
                 current = current->next;
@@ -49,8 +106,8 @@ int queue_push(TaskQueue* queue, void* data, int priority) {
 
             if (!current) {
                 // Insert at tail
-                queue->tail->next = new_task;
-                queue->tail = new_task;
+                shard->tail->next = new_task;
+                shard->tail = new_task;
             } else {
                 // Insert in middle
                 new_task->next = current;
@@ -59,57 +116,104 @@ int queue_push(TaskQueue* queue, void* data, int priority) {
         }
     }
 
-    queue->size++;
-    pthread_mutex_unlock(&queue->lock);
+    atomic_store_explicit(&shard->head_priority, priority_hint(shard->head->priority),
+                          memory_order_relaxed);
+    atomic_fetch_add_explicit(&queue->size, 1, memory_order_relaxed);
+    pthread_mutex_unlock(&shard->lock);
     return 0;
 }
 
-// Remove and return the highest priority task
-void* queue_pop(TaskQueue* queue) {
-    if (!queue || !queue->head) return NULL;
+// Pop the head of one shard, or NULL if it turned out to be empty
+static void* shard_pop(TaskQueue* queue, TaskQueueShard* shard) {
+    pthread_mutex_lock(&shard->lock);
 
-    pthread_mutex_lock(&queue->lock);
-    
-    Task* task = queue->head;
-    void* data = task->data;
-    
-    queue->head = task->next;
-    if (!queue->head) {
-        queue->tail = NULL;
+    Task* task = shard->head;
+    if (!task) {
+        pthread_mutex_unlock(&shard->lock);
+        return NULL;
+    }
+
+    shard->head = task->next;
+    if (!shard->head) {
+        shard->tail = NULL;
     }
-    
-    queue->size--;
-    pthread_mutex_unlock(&queue->lock);
-    
+    atomic_store_explicit(&shard->head_priority,
+                          shard->head ? priority_hint(shard->head->priority) : QUEUE_EMPTY_PRIORITY,
+                          memory_order_relaxed);
+    atomic_fetch_sub_explicit(&queue->size, 1, memory_order_relaxed);
+    pthread_mutex_unlock(&shard->lock);
+
+    void* data = task->data;
     free(task);
     return data;
 }
 
+// Remove and return a high priority task: sample a few shard heads without locking
+// and pop the best one; fall back to a full scan for the best head when the samples are empty
+void* queue_pop(TaskQueue* queue) {
+    if (!queue || atomic_load_explicit(&queue->size, memory_order_relaxed) == 0) return NULL;
+
+    TaskQueueShard* best = NULL;
+    int best_priority = QUEUE_EMPTY_PRIORITY;
+    for (int i = 0; i < QUEUE_POP_CHOICES; i++) {
+        TaskQueueShard* shard = &queue->shards[next_random() % (unsigned int)queue->num_shards];
+        int priority = atomic_load_explicit(&shard->head_priority, memory_order_relaxed);
+        if (priority < best_priority) {
+            best = shard;
+            best_priority = priority;
+        }
+    }
+
+    if (best) {
+        void* data = shard_pop(queue, best);
+        if (data) return data;
+    }
+
+    // Retry while some shard still looks non-empty; a failed pop means another
+    // consumer took that head first
+    for (;;) {
+        best = NULL;
+        best_priority = QUEUE_EMPTY_PRIORITY;
+        for (int i = 0; i < queue->num_shards; i++) {
+            TaskQueueShard* shard = &queue->shards[i];
+            int priority = atomic_load_explicit(&shard->head_priority, memory_order_relaxed);
+            if (priority < best_priority) {
+                best = shard;
+                best_priority = priority;
+            }
+        }
+        if (!best) return NULL;
+
+        void* data = shard_pop(queue, best);
+        if (data) return data;
+    }
+}
+
 // Get current queue size
 int queue_size(TaskQueue* queue) {
     if (!queue) return 0;
-    
-    pthread_mutex_lock(&queue->lock);
-    int size = queue->size;
-    pthread_mutex_unlock(&queue->lock);
-    
-    return size;
+    return atomic_load_explicit(&queue->size, memory_order_relaxed);
 }
 
 // Clean up queue resources
 void queue_destroy(TaskQueue* queue) {
     if (!queue) return;
 
-    pthread_mutex_lock(&queue->lock);
-    
-    Task* current = queue->head;
-    while (current) {
-        Task* next = current->next;
-        free(current);
-        current = next;
+    for (int i = 0; i < queue->num_shards; i++) {
+        TaskQueueShard* shard = &queue->shards[i];
+        pthread_mutex_lock(&shard->lock);
+
+        Task* current = shard->head;
+        while (current) {
+            Task* next = current->next;
+            free(current);
+            current = next;
+        }
+
+        pthread_mutex_unlock(&shard->lock);
+        pthread_mutex_destroy(&shard->lock);
     }
-    
-    pthread_mutex_unlock(&queue->lock);
-    pthread_mutex_destroy(&queue->lock);
+
+    free(queue->shards);
     free(queue);
-} 
\ No newline at end of file
+}
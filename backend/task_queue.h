@@ -1,6 +1,15 @@
 #ifndef TASK_QUEUE_H
 #define TASK_QUEUE_H
 
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define QUEUE_CACHE_LINE 64
+#define QUEUE_MAX_SHARDS 64
+#define QUEUE_POP_CHOICES 2   // Shards sampled per pop (power of two choices)
+#define QUEUE_EMPTY_PRIORITY INT_MAX
+
 // Task structure
 typedef struct Task {
     int priority;
@@ -8,19 +17,27 @@ typedef struct Task {
     struct Task* next;
 } Task;
 
-// Queue structure
-typedef struct TaskQueue {
+// One independently locked slice of the queue, padded to its own cache lines
+typedef struct {
+    _Alignas(QUEUE_CACHE_LINE) pthread_mutex_t lock;
     Task* head;
     Task* tail;
-    pthread_mutex_t lock;
-    int size;
+    atomic_int head_priority;  // Priority at the head, QUEUE_EMPTY_PRIORITY when empty
+} TaskQueueShard;
+
+// Queue structure
+typedef struct TaskQueue {
+    TaskQueueShard* shards;
+    int num_shards;
+    atomic_int size;           // Relaxed aggregate over all shards
 } TaskQueue;
 
 // Core functions
 TaskQueue* queue_init(void);
+TaskQueue* queue_init_sharded(int num_shards);
 int queue_push(TaskQueue* queue, void* data, int priority);
 void* queue_pop(TaskQueue* queue);
 int queue_size(TaskQueue* queue);
 void queue_destroy(TaskQueue* queue);
 
-#endif // TASK_QUEUE_H 
\ No newline at end of file
+#endif // TASK_QUEUE_H
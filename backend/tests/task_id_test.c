@@ -0,0 +1,76 @@
+// Concurrency check for task_id_next: many threads generate IDs at once and every ID
+// must be unique, carry the configured node and survive a format/parse round trip.
+// Build from backend/: gcc -O2 -I. -o tests/task_id_test tests/task_id_test.c task_id.c -pthread
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "task_id.h"
+
+#define TEST_THREADS 16
+#define TEST_IDS_PER_THREAD 250000
+#define TEST_NODE 513
+
+static uint64_t ids[TEST_THREADS * TEST_IDS_PER_THREAD];
+
+// Fill this thread's slice of ids
+static void* generate(void* arg) {
+    uint64_t* out = &ids[(size_t)(intptr_t)arg * TEST_IDS_PER_THREAD];
+    for (int i = 0; i < TEST_IDS_PER_THREAD; i++) {
+        out[i] = task_id_next();
+    }
+    return NULL;
+}
+
+static int compare_ids(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+int main(void) {
+    task_id_init(TEST_NODE);
+
+    pthread_t threads[TEST_THREADS];
+    for (int i = 0; i < TEST_THREADS; i++) {
+        if (pthread_create(&threads[i], NULL, generate, (void*)(intptr_t)i) != 0) {
+            fprintf(stderr, "Failed to start thread %d\n", i);
+            return 1;
+        }
+    }
+    for (int i = 0; i < TEST_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    size_t total = (size_t)TEST_THREADS * TEST_IDS_PER_THREAD;
+    int failures = 0;
+
+    for (size_t i = 0; i < total && failures < 10; i++) {
+        unsigned int node = (unsigned int)(ids[i] >> TASK_ID_SEQ_BITS) & TASK_ID_MAX_NODE;
+        if (node != TEST_NODE) {
+            fprintf(stderr, "ID %016llx carries node %u\n", (unsigned long long)ids[i], node);
+            failures++;
+        }
+
+        char buf[TASK_ID_STR_LEN];
+        uint64_t parsed;
+        task_id_format("task", ids[i], buf);
+        if (task_id_parse(buf, &parsed) != 0 || parsed != ids[i]) {
+            fprintf(stderr, "ID %s does not round-trip\n", buf);
+            failures++;
+        }
+    }
+
+    qsort(ids, total, sizeof(uint64_t), compare_ids);
+    size_t duplicates = 0;
+    for (size_t i = 1; i < total; i++) {
+        if (ids[i] == ids[i - 1]) duplicates++;
+    }
+    if (duplicates > 0) {
+        fprintf(stderr, "%zu duplicate IDs out of %zu\n", duplicates, total);
+        failures++;
+    }
+
+    if (failures > 0) return 1;
+    printf("%zu IDs from %d threads, all unique\n", total, TEST_THREADS);
+    return 0;
+}
@@ -0,0 +1,298 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "topology.h"
+
+#define MPOL_PREFERRED 1   // From <numaif.h>, which we avoid to not depend on libnuma
+
+#define BITS_PER_WORD (8 * sizeof(unsigned long))
+
+static void cpuset_add(CpuSet* set, int cpu) {
+    set->bits[cpu / BITS_PER_WORD] |= 1UL << (cpu % BITS_PER_WORD);
+}
+
+static bool cpuset_has(const CpuSet* set, int cpu) {
+    return (set->bits[cpu / BITS_PER_WORD] >> (cpu % BITS_PER_WORD)) & 1UL;
+}
+
+static int cpuset_count(const CpuSet* set) {
+    int count = 0;
+    for (size_t i = 0; i < TOPOLOGY_CPU_WORDS; i++) {
+        count += __builtin_popcountl(set->bits[i]);
+    }
+    return count;
+}
+
+// The n-th CPU of a set (wrapping around), or -1 for an empty set
+static int cpuset_nth(const CpuSet* set, int n) {
+    int count = cpuset_count(set);
+    if (count == 0) return -1;
+
+    n %= count;
+    for (int cpu = 0; cpu < TOPOLOGY_MAX_CPUS; cpu++) {
+        if (cpuset_has(set, cpu) && n-- == 0) return cpu;
+    }
+    return -1;
+}
+
+// Whether two sets share at least one CPU
+static bool cpuset_overlaps(const CpuSet* a, const CpuSet* b) {
+    for (size_t i = 0; i < TOPOLOGY_CPU_WORDS; i++) {
+        if (a->bits[i] & b->bits[i]) return true;
+    }
+    return false;
+}
+
+// Intersection, falling back to `b` alone when the sets do not overlap
+// (topology_init warns about such nodes)
+static CpuSet cpuset_restrict(const CpuSet* a, const CpuSet* b) {
+    CpuSet out;
+    for (size_t i = 0; i < TOPOLOGY_CPU_WORDS; i++) {
+        out.bits[i] = a->bits[i] & b->bits[i];
+    }
+    return cpuset_count(&out) > 0 ? out : *b;
+}
+
+// Warn about nodes a CPU list from `variable` does not cover; threads placed on
+// those nodes ignore the list and may run on any CPU of the node
+static void warn_uncovered_nodes(const Topology* topology, const char* variable, const CpuSet* set) {
+    for (int node = 0; node < topology->num_nodes; node++) {
+        if (!cpuset_overlaps(set, &topology->node_cpus[node])) {
+            fprintf(stderr, "[TOPOLOGY] %s has no CPU on node %d, threads placed there use all of its CPUs\n",
+                    variable, node);
+        }
+    }
+}
+
+// Parse a Linux CPU list such as "0-3,8,10-11"; returns the number of CPUs or -1
+int topology_parse_cpus(const char* spec, CpuSet* set) {
+    memset(set, 0, sizeof(CpuSet));
+    if (!spec) return -1;
+
+    const char* p = spec;
+    while (*p) {
+        while (isspace((unsigned char)*p)) p++;
+        if (!isdigit((unsigned char)*p)) return -1;
+
+        char* end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1) return -1;
+            p = end;
+        }
+        if (first < 0 || last < first || last >= TOPOLOGY_MAX_CPUS) return -1;
+
+        for (long cpu = first; cpu <= last; cpu++) {
+            cpuset_add(set, (int)cpu);
+        }
+
+        while (isspace((unsigned char)*p)) p++;
+        if (*p == ',') p++;
+        else if (*p) return -1;
+    }
+    return cpuset_count(set);
+}
+
+// CPUs this process is allowed to run on
+static void allowed_cpus(CpuSet* set) {
+    memset(set, 0, sizeof(CpuSet));
+
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE && cpu < TOPOLOGY_MAX_CPUS; cpu++) {
+            if (CPU_ISSET(cpu, &mask)) cpuset_add(set, cpu);
+        }
+    }
+    if (cpuset_count(set) == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        for (long cpu = 0; cpu < online && cpu < TOPOLOGY_MAX_CPUS; cpu++) {
+            cpuset_add(set, (int)cpu);
+        }
+    }
+}
+
+// Read node CPU lists from sysfs; returns the number of nodes found
+static int read_sysfs_nodes(Topology* topology) {
+    int nodes = 0;
+    for (int node = 0; node < TOPOLOGY_MAX_NODES; node++) {
+        char path[64];
+        char line[4096];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+
+        FILE* file = fopen(path, "r");
+        if (!file) break;
+        bool ok = fgets(line, sizeof(line), file) != NULL;
+        fclose(file);
+
+        line[strcspn(line, "\n")] = '\0';
+        if (!ok || topology_parse_cpus(line, &topology->node_cpus[node]) <= 0) break;
+        nodes++;
+    }
+    return nodes;
+}
+
+// Split the allowed CPUs into `nodes` contiguous groups to fake a multi-socket host
+static void simulate_nodes(Topology* topology, const CpuSet* cpus, int nodes) {
+    int count = cpuset_count(cpus);
+    for (int i = 0; i < count || i < nodes; i++) {
+        int node = count >= nodes ? i * nodes / count : i;
+        cpuset_add(&topology->node_cpus[node], cpuset_nth(cpus, i));
+    }
+    topology->num_nodes = nodes;
+    topology->simulated = true;
+}
+
+// Apply a CPU set to the calling thread
+static int pin_current_thread(const CpuSet* set) {
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    for (int cpu = 0; cpu < CPU_SETSIZE && cpu < TOPOLOGY_MAX_CPUS; cpu++) {
+        if (cpuset_has(set, cpu)) CPU_SET(cpu, &mask);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask);
+}
+
+// Prefer allocations of the calling thread on `node`; falls back to first-touch placement
+static void bind_memory(const Topology* topology, int node) {
+    if (!topology->numa || topology->simulated) return;
+
+    unsigned long nodemask = 1UL << node;
+    if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, &nodemask, TOPOLOGY_MAX_NODES + 1) != 0) {
+        static atomic_bool warned;
+        if (!atomic_exchange(&warned, true)) {
+            fprintf(stderr, "[TOPOLOGY] set_mempolicy failed (errno %d), using first-touch placement\n",
+                    errno);
+        }
+    }
+}
+
+// Build the topology from sysfs and the environment
+Topology* topology_init(void) {
+    Topology* topology = (Topology*)calloc(1, sizeof(Topology));
+    if (!topology) return NULL;
+
+    CpuSet cpus;
+    allowed_cpus(&cpus);
+
+    const char* numa_str = getenv("NUMA_MODE");
+    topology->numa = numa_str && strcmp(numa_str, "1") == 0;
+
+    const char* simulate_str = getenv("NUMA_SIMULATE_NODES");
+    int simulated_nodes = simulate_str ? atoi(simulate_str) : 0;
+    if (simulated_nodes > TOPOLOGY_MAX_NODES) simulated_nodes = TOPOLOGY_MAX_NODES;
+
+    if (simulated_nodes > 0) {
+        simulate_nodes(topology, &cpus, simulated_nodes);
+    } else {
+        topology->num_nodes = read_sysfs_nodes(topology);
+        if (topology->num_nodes == 0) {
+            topology->node_cpus[0] = cpus;
+            topology->num_nodes = 1;
+        }
+    }
+
+    const char* worker_str = getenv("WORKER_CPUS");
+    topology->pin_workers = worker_str && topology_parse_cpus(worker_str, &topology->worker_cpus) > 0;
+    if (!topology->pin_workers) topology->worker_cpus = cpus;
+
+    const char* http_str = getenv("HTTP_CPUS");
+    topology->pin_http = http_str && topology_parse_cpus(http_str, &topology->http_cpus) > 0;
+    if (!topology->pin_http) topology->http_cpus = cpus;
+
+    atomic_init(&topology->next_http_node, 0);
+
+    if (topology->numa) {
+        if (topology->pin_workers) warn_uncovered_nodes(topology, "WORKER_CPUS", &topology->worker_cpus);
+        if (topology->pin_http) warn_uncovered_nodes(topology, "HTTP_CPUS", &topology->http_cpus);
+    }
+
+    printf("[TOPOLOGY] %d %s node(s), NUMA mode %s\n", topology->num_nodes,
+           topology->simulated ? "simulated" : "detected", topology->numa ? "on" : "off");
+    for (int node = 0; node < topology->num_nodes; node++) {
+        printf("[TOPOLOGY] Node %d: %d CPU(s)\n", node, cpuset_count(&topology->node_cpus[node]));
+    }
+    return topology;
+}
+
+// Node of the CPU the calling thread is running on
+int topology_current_node(const Topology* topology) {
+    if (!topology || !topology->numa || topology->num_nodes <= 1) return 0;
+
+    int cpu = sched_getcpu();
+    if (cpu < 0 || cpu >= TOPOLOGY_MAX_CPUS) return 0;
+
+    for (int node = 0; node < topology->num_nodes; node++) {
+        if (cpuset_has(&topology->node_cpus[node], cpu)) return node;
+    }
+    return 0;
+}
+
+// Node a worker belongs to; workers are spread round-robin across nodes
+int topology_worker_node(const Topology* topology, int worker_id) {
+    if (!topology || !topology->numa) return 0;
+    return worker_id % topology->num_nodes;
+}
+
+// CPU a worker is pinned to, or -1 when worker pinning is off
+int topology_worker_cpu(const Topology* topology, int worker_id) {
+    if (!topology || !topology->pin_workers) return -1;
+    if (!topology->numa) return cpuset_nth(&topology->worker_cpus, worker_id);
+
+    int node = topology_worker_node(topology, worker_id);
+    CpuSet allowed = cpuset_restrict(&topology->worker_cpus, &topology->node_cpus[node]);
+    return cpuset_nth(&allowed, worker_id / topology->num_nodes);
+}
+
+// Pin the calling worker thread and bind its memory to its node
+void topology_place_worker(const Topology* topology, int node, int cpu) {
+    if (!topology) return;
+
+    CpuSet set;
+    memset(&set, 0, sizeof(set));
+    if (cpu >= 0) {
+        cpuset_add(&set, cpu);
+    } else if (topology->numa) {
+        set = topology->node_cpus[node];
+    } else {
+        return;
+    }
+
+    if (pin_current_thread(&set) != 0) {
+        fprintf(stderr, "[TOPOLOGY] Failed to pin worker thread to node %d\n", node);
+    }
+    bind_memory(topology, node);
+}
+
+// Pin a new HTTP connection thread; in NUMA mode threads are spread over nodes so
+// the payloads they allocate stay on the node whose queue shard they land in
+void topology_place_http_thread(Topology* topology) {
+    if (!topology || (!topology->pin_http && !topology->numa)) return;
+
+    CpuSet set = topology->http_cpus;
+    int node = 0;
+    if (topology->numa) {
+        node = atomic_fetch_add(&topology->next_http_node, 1) % topology->num_nodes;
+        set = cpuset_restrict(&topology->http_cpus, &topology->node_cpus[node]);
+    }
+
+    if (pin_current_thread(&set) != 0) {
+        fprintf(stderr, "[TOPOLOGY] Failed to pin HTTP thread\n");
+    }
+    bind_memory(topology, node);
+}
+
+// Clean up topology resources
+void topology_destroy(Topology* topology) {
+    free(topology);
+}
@@ -0,0 +1,42 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#define TOPOLOGY_MAX_NODES 8
+#define TOPOLOGY_MAX_CPUS 1024
+#define TOPOLOGY_CPU_WORDS (TOPOLOGY_MAX_CPUS / (8 * sizeof(unsigned long)))
+
+// Fixed-size CPU bitmask (kept independent of glibc's cpu_set_t)
+typedef struct {
+    unsigned long bits[TOPOLOGY_CPU_WORDS];
+} CpuSet;
+
+// CPU/NUMA layout and thread placement policy, read from the environment:
+//   WORKER_CPUS / HTTP_CPUS    CPU lists ("0-3,8") to pin worker and HTTP threads to
+//   NUMA_MODE=1                per-node queue shards and node-local allocation
+//   NUMA_SIMULATE_NODES=N      split the available CPUs into N fake nodes for testing
+typedef struct {
+    int num_nodes;
+    bool simulated;
+    bool numa;
+    CpuSet node_cpus[TOPOLOGY_MAX_NODES];
+    CpuSet worker_cpus;
+    CpuSet http_cpus;
+    bool pin_workers;
+    bool pin_http;
+    atomic_int next_http_node;   // Round-robin node for new HTTP threads
+} Topology;
+
+// Core functions
+Topology* topology_init(void);
+int topology_parse_cpus(const char* spec, CpuSet* set);
+int topology_current_node(const Topology* topology);
+int topology_worker_node(const Topology* topology, int worker_id);
+int topology_worker_cpu(const Topology* topology, int worker_id);
+void topology_place_worker(const Topology* topology, int node, int cpu);
+void topology_place_http_thread(Topology* topology);
+void topology_destroy(Topology* topology);
+
+#endif // TOPOLOGY_H
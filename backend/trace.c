@@ -0,0 +1,264 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "trace.h"
+#include "task_id.h"
+
+// Chrome trace-event names of the lifecycle points
+static const char* event_names[TRACE_NUM_EVENTS] = {
+    "receive", "enqueue", "dequeue", "start", "end", "notify"
+};
+
+// Name of the stage that ends at each lifecycle point
+static const char* stage_names[TRACE_NUM_EVENTS] = {
+    NULL, "admission", "queue_wait", "dispatch", "process", "notify"
+};
+
+static int sample_every = 0;                 // Trace 1 in N tasks, 0 disables tracing
+static TraceRing* rings[TRACE_MAX_THREADS];
+static atomic_int ring_count = 0;
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t ring_key;
+static bool ring_key_created = false;
+static _Thread_local TraceRing* local_ring = NULL;
+static _Thread_local bool local_ring_failed = false;
+
+// An exported event, tagged with the ring it came from
+typedef struct {
+    uint64_t task;
+    uint64_t timestamp;
+    uint32_t event;
+    int tid;
+} TraceSample;
+
+// Thread exit hook: the ring and its events stay around for the next thread
+static void release_ring(void* ring) {
+    atomic_store(&((TraceRing*)ring)->in_use, false);
+}
+
+// Give the calling thread a ring: a released one if any, otherwise a new one
+static TraceRing* claim_ring(void) {
+    TraceRing* ring = NULL;
+
+    pthread_mutex_lock(&rings_lock);
+    int count = atomic_load(&ring_count);
+    for (int i = 0; i < count && !ring; i++) {
+        if (!atomic_load(&rings[i]->in_use)) ring = rings[i];
+    }
+    if (!ring && count < TRACE_MAX_THREADS) {
+        ring = (TraceRing*)calloc(1, sizeof(TraceRing));
+        if (ring) {
+            rings[count] = ring;
+            atomic_store(&ring_count, count + 1);
+        }
+    }
+    if (ring) {
+        atomic_store(&ring->in_use, true);
+        strcpy(ring->name, "thread");
+    }
+    pthread_mutex_unlock(&rings_lock);
+
+    if (ring) {
+        pthread_setspecific(ring_key, ring);
+    } else {
+        local_ring_failed = true;
+    }
+    return ring;
+}
+
+// Decide per task, so every thread agrees on whether a task is traced
+static bool sampled(uint64_t id) {
+    if (sample_every == 1) return true;
+    return ((id * 0x9E3779B97F4A7C15ULL) >> 32) % (uint64_t)sample_every == 0;
+}
+
+// Configure sampling; call before any thread records events
+void trace_init(int sample_every_n) {
+    sample_every = sample_every_n > 0 ? sample_every_n : 0;
+    if (sample_every > 0 && !ring_key_created) {
+        ring_key_created = pthread_key_create(&ring_key, release_ring) == 0;
+    }
+}
+
+// Current CLOCK_MONOTONIC time in nanoseconds
+uint64_t trace_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Label the calling thread in exported traces
+void trace_set_thread_name(const char* name) {
+    if (sample_every == 0) return;
+    if (!local_ring && (local_ring_failed || !(local_ring = claim_ring()))) return;
+
+    pthread_mutex_lock(&rings_lock);
+    strncpy(local_ring->name, name, TRACE_NAME_LEN - 1);
+    local_ring->name[TRACE_NAME_LEN - 1] = '\0';
+    pthread_mutex_unlock(&rings_lock);
+}
+
+// Record a lifecycle point of a task at the current time
+void trace_event(const char* task_id, TraceEvent event) {
+    if (sample_every == 0) return;
+    trace_event_at(task_id, event, trace_now());
+}
+
+// Record a lifecycle point of a task at an earlier trace_now() time
+void trace_event_at(const char* task_id, TraceEvent event, uint64_t timestamp) {
+    if (sample_every == 0 || !task_id) return;
+
+    uint64_t id;
+    if (task_id_parse(task_id, &id) != 0) id = task_id_key(task_id);
+    if (!sampled(id)) return;
+
+    if (!local_ring && (local_ring_failed || !(local_ring = claim_ring()))) return;
+
+    // Single writer: invalidate the slot, fill it, then publish it
+    uint64_t pos = atomic_load_explicit(&local_ring->head, memory_order_relaxed);
+    TraceRecord* record = &local_ring->records[pos & (TRACE_RING_SIZE - 1)];
+    atomic_store_explicit(&record->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&record->task, id, memory_order_relaxed);
+    atomic_store_explicit(&record->timestamp, timestamp, memory_order_relaxed);
+    atomic_store_explicit(&record->event, (uint32_t)event, memory_order_relaxed);
+    atomic_store_explicit(&record->seq, pos + 1, memory_order_release);
+    atomic_store_explicit(&local_ring->head, pos + 1, memory_order_release);
+}
+
+// Order samples by task, then time, so each task's events are adjacent
+static int compare_samples(const void* a, const void* b) {
+    const TraceSample* x = (const TraceSample*)a;
+    const TraceSample* y = (const TraceSample*)b;
+    if (x->task != y->task) return x->task < y->task ? -1 : 1;
+    if (x->timestamp != y->timestamp) return x->timestamp < y->timestamp ? -1 : 1;
+    return (int)x->event - (int)y->event;
+}
+
+// Append one Chrome trace event
+static void add_event(struct json_object* events, const char* name, const char* phase,
+                      uint64_t timestamp, int tid, const char* task_id) {
+    struct json_object* event = json_object_new_object();
+    json_object_object_add(event, "name", json_object_new_string(name));
+    json_object_object_add(event, "cat", json_object_new_string("task"));
+    json_object_object_add(event, "ph", json_object_new_string(phase));
+    json_object_object_add(event, "ts", json_object_new_double(timestamp / 1000.0));
+    json_object_object_add(event, "pid", json_object_new_int(1));
+    json_object_object_add(event, "tid", json_object_new_int(tid));
+    if (phase[0] == 'i') {
+        json_object_object_add(event, "s", json_object_new_string("t"));
+        struct json_object* args = json_object_new_object();
+        json_object_object_add(args, "task", json_object_new_string(task_id));
+        json_object_object_add(event, "args", args);
+    } else {
+        json_object_object_add(event, "id", json_object_new_string(task_id));
+    }
+    json_object_array_add(events, event);
+}
+
+// Events of the last `seconds` seconds as Chrome trace-event JSON. Each thread gets
+// its lifecycle points as instant events, and each task an async span split into
+// stages (admission, queue_wait, dispatch, process, notify).
+struct json_object* trace_export(int seconds) {
+    uint64_t now = trace_now();
+    uint64_t window = (uint64_t)seconds * 1000000000ULL;
+    uint64_t since = now > window ? now - window : 0;
+
+    int count = atomic_load(&ring_count);
+    TraceSample* samples = (TraceSample*)malloc(sizeof(TraceSample) * TRACE_RING_SIZE *
+                                                (count > 0 ? count : 1));
+    if (!samples) return NULL;
+
+    int total = 0;
+    for (int i = 0; i < count; i++) {
+        TraceRing* ring = rings[i];
+        uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        uint64_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+
+        for (uint64_t pos = first; pos < head; pos++) {
+            TraceRecord* record = &ring->records[pos & (TRACE_RING_SIZE - 1)];
+            if (atomic_load_explicit(&record->seq, memory_order_acquire) != pos + 1) continue;
+
+            TraceSample sample = {
+                .task = atomic_load_explicit(&record->task, memory_order_relaxed),
+                .timestamp = atomic_load_explicit(&record->timestamp, memory_order_relaxed),
+                .event = atomic_load_explicit(&record->event, memory_order_relaxed),
+                .tid = i,
+            };
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&record->seq, memory_order_relaxed) != pos + 1) continue;
+            if (sample.timestamp < since || sample.event >= TRACE_NUM_EVENTS) continue;
+
+            samples[total++] = sample;
+        }
+    }
+    qsort(samples, total, sizeof(TraceSample), compare_samples);
+
+    struct json_object* events = json_object_new_array();
+    pthread_mutex_lock(&rings_lock);
+    for (int i = 0; i < count; i++) {
+        struct json_object* meta = json_object_new_object();
+        struct json_object* args = json_object_new_object();
+        json_object_object_add(args, "name", json_object_new_string(rings[i]->name));
+        json_object_object_add(meta, "name", json_object_new_string("thread_name"));
+        json_object_object_add(meta, "ph", json_object_new_string("M"));
+        json_object_object_add(meta, "pid", json_object_new_int(1));
+        json_object_object_add(meta, "tid", json_object_new_int(i));
+        json_object_object_add(meta, "args", args);
+        json_object_array_add(events, meta);
+    }
+    pthread_mutex_unlock(&rings_lock);
+
+    for (int start = 0; start < total; ) {
+        int end = start;
+        while (end < total && samples[end].task == samples[start].task) end++;
+
+        char task_id[TASK_ID_STR_LEN];
+        task_id_format("task", samples[start].task, task_id);
+
+        add_event(events, task_id, "b", samples[start].timestamp, samples[start].tid, task_id);
+        for (int i = start; i < end; i++) {
+            add_event(events, event_names[samples[i].event], "i",
+                      samples[i].timestamp, samples[i].tid, task_id);
+            if (i > start && stage_names[samples[i].event]) {
+                add_event(events, stage_names[samples[i].event], "b",
+                          samples[i - 1].timestamp, samples[i - 1].tid, task_id);
+                add_event(events, stage_names[samples[i].event], "e",
+                          samples[i].timestamp, samples[i].tid, task_id);
+            }
+        }
+        add_event(events, task_id, "e", samples[end - 1].timestamp, samples[end - 1].tid, task_id);
+        start = end;
+    }
+    free(samples);
+
+    struct json_object* trace = json_object_new_object();
+    json_object_object_add(trace, "traceEvents", events);
+    json_object_object_add(trace, "displayTimeUnit", json_object_new_string("ms"));
+    struct json_object* info = json_object_new_object();
+    json_object_object_add(info, "sample_every", json_object_new_int(sample_every));
+    json_object_object_add(info, "seconds", json_object_new_int(seconds));
+    json_object_object_add(trace, "otherData", info);
+    return trace;
+}
+
+// Free all rings; every thread that recorded events must have exited
+void trace_destroy(void) {
+    pthread_mutex_lock(&rings_lock);
+    int count = atomic_load(&ring_count);
+    for (int i = 0; i < count; i++) {
+        free(rings[i]);
+        rings[i] = NULL;
+    }
+    atomic_store(&ring_count, 0);
+    pthread_mutex_unlock(&rings_lock);
+
+    local_ring = NULL;
+    if (ring_key_created) {
+        pthread_key_delete(ring_key);
+        ring_key_created = false;
+    }
+    sample_every = 0;
+}
@@ -0,0 +1,49 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <json-c/json.h>
+
+#define TRACE_RING_SIZE 4096      // Events kept per thread (power of two)
+#define TRACE_MAX_THREADS 256     // Rings of exited threads are reused by new ones
+#define TRACE_NAME_LEN 16
+
+// Task lifecycle points, in the order a task passes them
+typedef enum {
+    TRACE_RECEIVE,    // HTTP request arrived
+    TRACE_ENQUEUE,    // Dependencies met, pushed to a ready queue
+    TRACE_DEQUEUE,    // Popped by a worker
+    TRACE_START,      // Processing began
+    TRACE_END,        // Processing finished
+    TRACE_NOTIFY,     // Completion recorded and dependents released
+    TRACE_NUM_EVENTS
+} TraceEvent;
+
+// One event; seq is written last so a reader can skip records being overwritten
+typedef struct {
+    atomic_uint_fast64_t seq;     // Ring position + 1, 0 while being written
+    _Atomic uint64_t task;        // Numeric task ID (see task_id_parse)
+    _Atomic uint64_t timestamp;   // CLOCK_MONOTONIC nanoseconds
+    _Atomic uint32_t event;
+} TraceRecord;
+
+// Event ring owned by one thread at a time
+typedef struct {
+    TraceRecord records[TRACE_RING_SIZE];
+    atomic_uint_fast64_t head;    // Events written so far
+    atomic_bool in_use;           // Claimed by a live thread
+    char name[TRACE_NAME_LEN];    // Guarded by the ring registry lock
+} TraceRing;
+
+// Core functions
+void trace_init(int sample_every);
+uint64_t trace_now(void);
+void trace_set_thread_name(const char* name);
+void trace_event(const char* task_id, TraceEvent event);
+void trace_event_at(const char* task_id, TraceEvent event, uint64_t timestamp);
+struct json_object* trace_export(int seconds);
+void trace_destroy(void);
+
+#endif // TRACE_H
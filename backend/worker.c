@@ -8,10 +8,14 @@
 #include <json-c/json.h>
 #include <libwebsockets.h>
 #include "worker.h"
+#include "trace.h"
 #include <time.h>
 
-// Forward declaration for the add_completed_task function from server.c
+// Forward declarations for the completion hooks from server.c
 extern void add_completed_task(const char* task_id);
+extern void store_task_result(const char* task_id, const char* data, size_t length);
+extern struct json_object* fetch_remote_task(void);
+extern void report_remote_completion(int origin_node, const char* task_id);
 
 // Function to get processing delay from environment variable or use default
 static int get_processing_delay() {
@@ -24,7 +28,7 @@ static int get_processing_delay() {
 }
 
 // Function to process a task
-static void process_task(struct json_object* task) {
+static void process_task(Worker* worker, struct json_object* task) {
     // Extract task ID
     struct json_object* id_obj;
     if (!json_object_object_get_ex(task, "id", &id_obj)) {
@@ -59,6 +63,7 @@ static void process_task(struct json_object* task) {
     
     printf("[WORKER] Processing task %s (priority: %d) for %d seconds...\n", 
            task_id, priority, sleep_time);
+    trace_event(task_id, TRACE_START);
     
     // Simulate processing with progress updates
     for (int i = 1; i <= sleep_time; i++) {
@@ -67,32 +72,83 @@ static void process_task(struct json_object* task) {
                task_id, i, sleep_time, (float)i/sleep_time * 100.0);
     }
     
+    trace_event(task_id, TRACE_END);
+    
     // Update task status to completed
     json_object_object_add(task, "status", json_object_new_string("completed"));
     
     printf("[WORKER] Task %s completed\n", task_id);
     
+    // Build the task result and hand it to the result store before announcing completion
+    struct json_object* result = json_object_new_object();
+    json_object_object_add(result, "id", json_object_new_string(task_id));
+    json_object_object_add(result, "status", json_object_new_string("completed"));
+    json_object_object_add(result, "worker_id", json_object_new_int(worker->worker_id));
+    json_object_object_add(result, "processing_time", json_object_new_int(sleep_time));
+    json_object_object_add(result, "data", json_object_get(data_obj));
+    
+    size_t result_len;
+    const char* result_str = json_object_to_json_string_length(result, JSON_C_TO_STRING_PLAIN, &result_len);
+    store_task_result(task_id, result_str, result_len);
+    json_object_put(result);
+    
     // Notify clients of task completion using the new function
     add_completed_task(task_id);
+    trace_event(task_id, TRACE_NOTIFY);
+    
+    // Let the node that scheduled this task release its dependents
+    struct json_object* origin_obj;
+    if (json_object_object_get_ex(task, "origin_node", &origin_obj)) {
+        report_remote_completion(json_object_get_int(origin_obj), task_id);
+    }
+}
+
+// Pop from the home queue first, then from the other nodes' shards,
+// and finally try to steal from a cluster peer
+static struct json_object* next_task(Worker* worker) {
+    struct json_object* task = queue_pop(worker->queue);
+    for (int i = 1; !task && i < worker->num_queues; i++) {
+        task = queue_pop(worker->queues[(worker->node + i) % worker->num_queues]);
+    }
+    if (!task) {
+        task = fetch_remote_task();
+    }
+    
+    struct json_object* id_obj;
+    if (task && json_object_object_get_ex(task, "id", &id_obj)) {
+        trace_event(json_object_get_string(id_obj), TRACE_DEQUEUE);
+    }
+    return task;
 }
 
 // Main worker thread function
 static void* worker_thread(void* arg) {
     Worker* worker = (Worker*)arg;
     
-    printf("Worker %d started\n", worker->worker_id);
+    topology_place_worker(worker->topology, worker->node, worker->cpu);
+    
+    char thread_name[TRACE_NAME_LEN];
+    snprintf(thread_name, sizeof(thread_name), "worker %d", worker->worker_id);
+    trace_set_thread_name(thread_name);
+    printf("Worker %d started (node %d, cpu %d)\n", worker->worker_id, worker->node, worker->cpu);
     
     while (worker->running) {
+        // Mark the worker busy before popping so a drain never sees a popped task as idle
+        atomic_store(&worker->busy, true);
+        
         // Process the task
-        struct json_object* task = queue_pop(worker->queue);
+        struct json_object* task = next_task(worker);
         if (task) {
-            process_task(task);
+            process_task(worker, task);
             json_object_put(task);
+            atomic_store(&worker->busy, false);
             
             // Add a small delay between tasks to make it easier to observe
             printf("[WORKER] Worker %d waiting for next task...\n", worker->worker_id);
             sleep(1);
         } else {
+            atomic_store(&worker->busy, false);
+            
             // Small sleep to prevent busy-waiting
             usleep(500000); // 500ms sleep
         }
@@ -103,12 +159,18 @@ static void* worker_thread(void* arg) {
 }
 
 // Create and start a new worker
-Worker* worker_create(TaskQueue* queue, int worker_id) {
+Worker* worker_create(TaskQueue** queues, int num_queues, const Topology* topology, int worker_id) {
     Worker* worker = (Worker*)malloc(sizeof(Worker));
     if (!worker) return NULL;
     
-    worker->queue = queue;
+    worker->node = topology_worker_node(topology, worker_id) % num_queues;
+    worker->cpu = topology_worker_cpu(topology, worker_id);
+    worker->queue = queues[worker->node];
+    worker->queues = queues;
+    worker->num_queues = num_queues;
+    worker->topology = topology;
     worker->running = true;
+    atomic_init(&worker->busy, false);
     worker->worker_id = worker_id;
     
     // Create the worker thread
@@ -135,12 +197,13 @@ void worker_destroy(Worker* worker) {
 }
 
 // Create a pool of workers
-Worker** create_worker_pool(TaskQueue* queue, int num_workers) {
+Worker** create_worker_pool(TaskQueue** queues, int num_queues, const Topology* topology,
+                            int num_workers) {
     Worker** workers = (Worker**)malloc(sizeof(Worker*) * num_workers);
     if (!workers) return NULL;
     
     for (int i = 0; i < num_workers; i++) {
-        workers[i] = worker_create(queue, i);
+        workers[i] = worker_create(queues, num_queues, topology, i);
         if (!workers[i]) {
             // Cleanup on failure
             for (int j = 0; j < i; j++) {
@@ -154,13 +217,27 @@ Worker** create_worker_pool(TaskQueue* queue, int num_workers) {
     return workers;
 }
 
-// Destroy a pool of workers
+// Destroy a pool of workers; all workers stop taking tasks before the first join,
+// and in-flight tasks run to completion
 void destroy_worker_pool(Worker** workers, int num_workers) {
     if (!workers) return;
     
+    for (int i = 0; i < num_workers; i++) {
+        workers[i]->running = false;
+    }
     for (int i = 0; i < num_workers; i++) {
         worker_destroy(workers[i]);
     }
     
     free(workers);
+}
+
+// Check whether no worker is currently holding a task
+bool worker_pool_idle(Worker** workers, int num_workers) {
+    if (!workers) return true;
+    
+    for (int i = 0; i < num_workers; i++) {
+        if (atomic_load(&workers[i]->busy)) return false;
+    }
+    return true;
 } 
\ No newline at end of file
@@ -1,21 +1,31 @@
 #ifndef WORKER_H
 #define WORKER_H
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include "task_queue.h"
+#include "topology.h"
 
 // Worker structure
 typedef struct {
     pthread_t thread;          // Thread handle
-    TaskQueue* queue;         // Reference to task queue
+    TaskQueue* queue;         // Home queue (the shard of the worker's node)
+    TaskQueue** queues;       // All queue shards, drained when the home queue is empty
+    int num_queues;           // Number of queue shards
+    const Topology* topology; // Placement policy, NULL to leave the thread unpinned
     bool running;             // Worker running flag
+    atomic_bool busy;         // Set while the worker holds a task
     int worker_id;           // Unique worker identifier
+    int node;                // NUMA node the worker serves
+    int cpu;                 // CPU the worker is pinned to, -1 if unpinned
 } Worker;
 
 // Function declarations
-Worker* worker_create(TaskQueue* queue, int worker_id);
+Worker* worker_create(TaskQueue** queues, int num_queues, const Topology* topology, int worker_id);
 void worker_destroy(Worker* worker);
-Worker** create_worker_pool(TaskQueue* queue, int num_workers);
+Worker** create_worker_pool(TaskQueue** queues, int num_queues, const Topology* topology,
+                            int num_workers);
 void destroy_worker_pool(Worker** workers, int num_workers);
+bool worker_pool_idle(Worker** workers, int num_workers);
 
 #endif // WORKER_H 
\ No newline at end of file